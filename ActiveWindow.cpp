@@ -0,0 +1,88 @@
+#include "ActiveWindow.hpp"
+
+#include <algorithm>
+#include <limits>
+
+void ActiveWindow::build(std::vector< float > const &spawn, std::vector< float > const &despawn) {
+	assert(spawn.size() == despawn.size());
+	assert(std::is_sorted(spawn.begin(), spawn.end()));
+
+	spawn_time = spawn;
+	despawn_time = despawn;
+
+	despawn_max.resize(despawn_time.size());
+	float running_max = -std::numeric_limits< float >::infinity();
+	for (size_t i = 0; i < despawn_time.size(); ++i) {
+		running_max = std::max(running_max, despawn_time[i]);
+		despawn_max[i] = running_max;
+	}
+
+	despawn_heap.reserve(spawn_time.size());
+	retiring.reserve(spawn_time.size());
+
+	reset();
+}
+
+void ActiveWindow::reset() {
+	retired.assign(spawn_time.size(), 0);
+	retired_total = 0;
+	next_spawn = 0;
+	head = 0;
+	count = 0;
+	retired_in_ring = 0;
+	despawn_heap.clear();
+	retiring.clear();
+}
+
+void ActiveWindow::seek(float time) {
+	reset();
+
+	//notes from 'next_spawn' on haven't spawned (advance admits at time >= spawn);
+	// notes before 'first' have all retired (advance retires at time > despawn):
+	next_spawn = uint32_t(std::upper_bound(spawn_time.begin(), spawn_time.end(), time) - spawn_time.begin());
+	uint32_t first = uint32_t(std::lower_bound(despawn_max.begin(), despawn_max.end(), time) - despawn_max.begin());
+	first = std::min(first, next_spawn);
+
+	std::fill(retired.begin(), retired.begin() + first, uint8_t(1));
+	retired_total = first;
+
+	//only notes in between may be live:
+	for (uint32_t note = first; note < next_spawn; ++note) {
+		if (time > despawn_time[note]) {
+			retired[note] = 1;
+			retired_total += 1;
+		} else {
+			push_live(note);
+			despawn_heap.emplace_back(despawn_time[note], note);
+		}
+	}
+	std::make_heap(despawn_heap.begin(), despawn_heap.end(), std::greater< Despawn >());
+}
+
+void ActiveWindow::push_live(uint32_t note) {
+	if (count == live.size()) {
+		//full: unroll into a buffer twice the size:
+		std::vector< uint32_t > grown(live.size() * 2);
+		for (uint32_t i = 0; i < count; ++i) {
+			grown[i] = live[(head + i) & (uint32_t(live.size()) - 1)];
+		}
+		live = std::move(grown);
+		head = 0;
+	}
+	live[(head + count) & (uint32_t(live.size()) - 1)] = note;
+	count += 1;
+}
+
+void ActiveWindow::compact_live() {
+	uint32_t mask = uint32_t(live.size()) - 1;
+	uint32_t kept = 0;
+	for (uint32_t i = 0; i < count; ++i) {
+		uint32_t note = live[(head + i) & mask];
+		if (!retired[note]) {
+			live[(head + kept) & mask] = note;
+			kept += 1;
+		}
+	}
+	count = kept;
+	retired_in_ring = 0;
+}
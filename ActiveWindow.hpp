@@ -0,0 +1,121 @@
+#pragma once
+
+/*
+ * An ActiveWindow tracks which notes are live (spawned but not yet retired)
+ *  as the song time advances.
+ *
+ * Each note has a spawn time and a despawn time. Spawn times must be
+ *  non-decreasing with note index (as they are for a beatmap sorted by hit time);
+ *  despawn times may be in any order (hold notes outlast the notes after them).
+ *
+ * Live notes are kept in a ring buffer in spawn order, and also in a min-heap
+ *  ordered by despawn time. Admitting a note pushes it on both; a step retires
+ *  notes by popping the heap only while its front has despawned, so a step costs
+ *  O(notes spawned or retired this step) (times log of the live count), however
+ *  many notes are live. Retired notes are marked in the ring, popped off its front
+ *  once everything before them has retired, and compacted out whenever they make
+ *  up more than half of it (e.g., behind a long hold note), so walking the ring
+ *  costs O(live notes).
+ *
+ * seek() jumps to any song time by binary searching the spawn times (and a running
+ *  maximum of the despawn times, below which every note has retired), then rebuilds
+ *  the ring and heap from the notes in between.
+ *
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+struct ActiveWindow {
+	//set up for a new song; the window starts empty, before the first note spawns:
+	// (spawn and despawn must be the same size)
+	void build(std::vector< float > const &spawn, std::vector< float > const &despawn);
+
+	//empty the window, so the next advance() admits from the first note again:
+	void reset();
+
+	//move forward to 'time', calling on_spawn(note) for every note admitted and
+	// on_retire(note) for every note whose despawn time has passed:
+	// (notes retired by one call are passed in index order)
+	template< typename Spawn, typename Retire >
+	void advance(float time, Spawn &&on_spawn, Retire &&on_retire);
+
+	//jump to any song time (forward or back), leaving the window as advancing from the start to 'time' would:
+	// (no callbacks are made; the caller is responsible for note state)
+	void seek(float time);
+
+	//live notes, in spawn order (may include notes retired since their slot was last compacted; skip those with is_retired):
+	uint32_t live_count() const { return count; }
+	uint32_t live_note(uint32_t i) const { return live[(head + i) & (uint32_t(live.size()) - 1)]; }
+	bool is_retired(uint32_t note) const { return retired[note] != 0; }
+
+	//true once every note has spawned and retired:
+	bool finished() const { return next_spawn == spawn_time.size() && count == 0; }
+	uint32_t retired_count() const { return retired_total; }
+
+	//----- internals -----
+	std::vector< float > spawn_time;
+	std::vector< float > despawn_time;
+	std::vector< float > despawn_max; //running maximum of despawn_time, used by seek()
+	std::vector< uint8_t > retired;
+
+	//live notes as a min-heap of (despawn time, note) (sized for every note in build(), so it never reallocates):
+	using Despawn = std::pair< float, uint32_t >;
+	std::vector< Despawn > despawn_heap;
+	std::vector< uint32_t > retiring; //notes retired by the current advance() (also sized in build())
+
+	uint32_t next_spawn = 0; //index of the next note to admit
+	uint32_t retired_total = 0;
+
+	//ring buffer of live note indices (size is a power of two):
+	std::vector< uint32_t > live = std::vector< uint32_t >(16);
+	uint32_t head = 0;
+	uint32_t count = 0;
+	uint32_t retired_in_ring = 0; //retired notes not yet popped or compacted out of the ring
+
+	void push_live(uint32_t note);
+	void compact_live(); //drop retired notes from the ring, keeping spawn order
+};
+
+template< typename Spawn, typename Retire >
+void ActiveWindow::advance(float time, Spawn &&on_spawn, Retire &&on_retire) {
+	//admit everything whose spawn time has arrived:
+	while (next_spawn < spawn_time.size() && time >= spawn_time[next_spawn]) {
+		push_live(next_spawn);
+		despawn_heap.emplace_back(despawn_time[next_spawn], next_spawn);
+		std::push_heap(despawn_heap.begin(), despawn_heap.end(), std::greater< Despawn >());
+		on_spawn(next_spawn);
+		next_spawn += 1;
+	}
+
+	//retire everything whose despawn time has passed (only those are touched):
+	retiring.clear();
+	while (!despawn_heap.empty() && time > despawn_heap.front().first) {
+		uint32_t note = despawn_heap.front().second;
+		std::pop_heap(despawn_heap.begin(), despawn_heap.end(), std::greater< Despawn >());
+		despawn_heap.pop_back();
+		retired[note] = 1;
+		retired_total += 1;
+		retired_in_ring += 1;
+		retiring.emplace_back(note);
+	}
+	//(in index order, as a sweep over the notes would)
+	std::sort(retiring.begin(), retiring.end());
+	for (uint32_t note : retiring) {
+		on_retire(note);
+	}
+
+	//pop retired notes off the front:
+	uint32_t mask = uint32_t(live.size()) - 1;
+	while (count > 0 && retired[live[head]]) {
+		head = (head + 1) & mask;
+		count -= 1;
+		retired_in_ring -= 1;
+	}
+	//...and if the rest are mostly retired (stuck behind a long-lived note), squeeze them out:
+	if (retired_in_ring * 2 > count) compact_live();
+}
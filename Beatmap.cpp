@@ -0,0 +1,283 @@
+#include "Beatmap.hpp"
+
+#include "read_write_chunk.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <cassert>
+#include <cerrno>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+	//read-only view of a whole file mapped into memory:
+	struct MappedFile {
+		MappedFile(std::string const &filename);
+		~MappedFile();
+		MappedFile(MappedFile const &) = delete;
+
+		char const *data = nullptr;
+		size_t size = 0;
+
+		#if defined(_WIN32)
+		HANDLE file = INVALID_HANDLE_VALUE;
+		HANDLE mapping = NULL;
+		#else
+		int fd = -1;
+		#endif
+	};
+
+	MappedFile::MappedFile(std::string const &filename) {
+		#if defined(_WIN32)
+		file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE) {
+			throw std::runtime_error("Failed to open '" + filename + "'.");
+		}
+		LARGE_INTEGER file_size;
+		if (!GetFileSizeEx(file, &file_size)) {
+			CloseHandle(file);
+			throw std::runtime_error("Failed to get size of '" + filename + "'.");
+		}
+		size = size_t(file_size.QuadPart);
+		if (size != 0) {
+			mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (mapping != NULL) data = reinterpret_cast< char const * >(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+			if (data == nullptr) {
+				if (mapping != NULL) CloseHandle(mapping);
+				CloseHandle(file);
+				throw std::runtime_error("Failed to map '" + filename + "'.");
+			}
+		}
+		#else
+		fd = open(filename.c_str(), O_RDONLY);
+		if (fd == -1) {
+			throw std::runtime_error("Failed to open '" + filename + "'.");
+		}
+		struct stat st;
+		if (fstat(fd, &st) != 0) {
+			close(fd);
+			throw std::runtime_error("Failed to get size of '" + filename + "'.");
+		}
+		size = size_t(st.st_size);
+		if (size != 0) {
+			void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (mapped == MAP_FAILED) {
+				close(fd);
+				throw std::runtime_error("Failed to map '" + filename + "'.");
+			}
+			data = reinterpret_cast< char const * >(mapped);
+		}
+		#endif
+	}
+
+	MappedFile::~MappedFile() {
+		#if defined(_WIN32)
+		if (data) UnmapViewOfFile(data);
+		if (mapping != NULL) CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+		#else
+		if (data) munmap(const_cast< char * >(data), size);
+		if (fd != -1) close(fd);
+		#endif
+	}
+
+	/*
+		Reads a txt file representing a beatmap
+			The whole file is read into one buffer and handed to Beatmap::parse_text
+	*/
+	void load_text(std::string const &filename, Beatmap *beatmap_) {
+		assert(beatmap_);
+		auto &beatmap = *beatmap_;
+
+		std::ifstream file(filename, std::ios::binary);
+		if (!file.is_open()) {
+			throw std::runtime_error("Failed to open beatmap '" + filename + "'.");
+		}
+
+		std::string buffer;
+		file.seekg(0, std::ios::end);
+		buffer.resize(size_t(file.tellg()));
+		file.seekg(0, std::ios::beg);
+		if (!file.read(&buffer[0], buffer.size())) {
+			throw std::runtime_error("Failed to read beatmap '" + filename + "'.");
+		}
+
+		beatmap.parse_text(buffer, filename);
+	}
+
+	void load_compiled(std::string const &filename, Beatmap *beatmap_) {
+		assert(beatmap_);
+		auto &beatmap = *beatmap_;
+
+		MappedFile file(filename);
+		char const *at = file.data;
+		char const *end = file.data + file.size;
+
+		read_chunk(&at, end, "bmn0", &beatmap.notes);
+		read_chunk(&at, end, "bmp0", &beatmap.points);
+
+		if (at != end) {
+			std::cerr << "WARNING: trailing data in beatmap file '" << filename << "'" << std::endl;
+		}
+
+		for (auto const &note : beatmap.notes) {
+			if (!(note.point_begin < note.point_end && note.point_end <= beatmap.points.size())) {
+				throw std::runtime_error("beatmap '" + filename + "' contains note with out-of-range point begin/end.");
+			}
+			if (note.type > NoteType::BURST || note.dir > NoteDir::RIGHT) {
+				throw std::runtime_error("beatmap '" + filename + "' contains note with invalid type or direction.");
+			}
+		}
+	}
+
+}
+
+Beatmap::Beatmap(std::string const &filename) {
+	if (filename.size() >= 6 && filename.substr(filename.size()-6) == ".beatc") {
+		load_compiled(filename, this);
+	} else if (filename.size() >= 4 && filename.substr(filename.size()-4) == ".txt") {
+		load_text(filename, this);
+	} else {
+		throw std::runtime_error("Beatmap '" + filename + "' doesn't end in either \".txt\" or \".beatc\" -- unsure how to load.");
+	}
+}
+
+//read all of 'token' as a float (false if it isn't exactly one number):
+static bool parse_float(std::string_view token, float *value) {
+#if defined(__cpp_lib_to_chars)
+	auto result = std::from_chars(token.data(), token.data() + token.size(), *value);
+	return result.ec == std::errc() && result.ptr == token.data() + token.size();
+#else
+	//float from_chars is missing from libc++ before LLVM 17 (e.g., Apple clang, which the macOS build uses),
+	// which only defines __cpp_lib_to_chars once it's there -- so fall back to strtof on a terminated copy:
+	char buffer[64];
+	if (token.empty() || token.size() >= sizeof(buffer)) return false;
+	//(strtof also takes leading whitespace, '+', and hex floats, which from_chars doesn't)
+	if (token[0] == '+' || token.find_first_of("xX \t\n\r\f\v") != std::string_view::npos) return false;
+	std::memcpy(buffer, token.data(), token.size());
+	buffer[token.size()] = '\0';
+	char *end = nullptr;
+	errno = 0;
+	*value = std::strtof(buffer, &end); //(the game never calls setlocale, so '.' is the decimal point)
+	return end == buffer + token.size() && errno != ERANGE;
+#endif
+}
+
+/*
+	Parses a chart in the text format
+		Each line represents one note (single, burst, hold)
+		In the format of <type> <skin number> <direction> <coord begin> [<coord> ...] @ <time begin> [<time> ...]
+		*** Each line must have its time begin and end be less than the time begins of all lines after it ***
+	Tokens are views into 'text' and numbers are read with from_chars (see parse_float), so the only allocations are the notes and points themselves.
+*/
+void Beatmap::parse_text(std::string_view text, std::string const &source) {
+	auto is_space = [](char c) {
+		return c == ' ' || c == '\t' || c == '\r';
+	};
+
+	uint32_t line_number = 0;
+	size_t line_begin = 0;
+	while (line_begin < text.size()) {
+		line_number += 1;
+		size_t line_end = text.find('\n', line_begin);
+		if (line_end == std::string_view::npos) line_end = text.size();
+		std::string_view line = text.substr(line_begin, line_end - line_begin);
+		line_begin = line_end + 1;
+
+		//walk the line one whitespace-separated token at a time:
+		size_t at = 0;
+		size_t column = 1; //column of the most recent token, for errors
+		auto error = [&](std::string const &message) {
+			return std::runtime_error("beatmap '" + source + "' line " + std::to_string(line_number) + " column " + std::to_string(column) + ": " + message);
+		};
+		auto next_token = [&]() -> std::string_view {
+			while (at < line.size() && is_space(line[at])) ++at;
+			size_t begin = at;
+			while (at < line.size() && !is_space(line[at])) ++at;
+			column = begin + 1;
+			return line.substr(begin, at - begin);
+		};
+		auto read_float = [&](std::string_view token) {
+			float value = 0.0f;
+			if (!parse_float(token, &value)) {
+				throw error("invalid number '" + std::string(token) + "'.");
+			}
+			return value;
+		};
+
+		std::string_view token = next_token();
+		if (token.empty()) continue;
+
+		Beatmap::Note note;
+		if (token == "single") note.type = NoteType::SINGLE;
+		else if (token == "burst") note.type = NoteType::BURST;
+		else if (token == "hold") note.type = NoteType::HOLD;
+		else throw error("unknown note type '" + std::string(token) + "'.");
+
+		token = next_token();
+		int skin = -1;
+		auto skin_result = std::from_chars(token.data(), token.data() + token.size(), skin);
+		if (token.empty() || skin_result.ec != std::errc() || skin_result.ptr != token.data() + token.size()) {
+			throw error("invalid skin number '" + std::string(token) + "'.");
+		}
+		if (skin < 0 || skin > 9) throw error("skin number must be in [0,9].");
+		note.skin = uint8_t(skin);
+
+		token = next_token();
+		if (token == "up") note.dir = NoteDir::UP;
+		else if (token == "down") note.dir = NoteDir::DOWN;
+		else if (token == "left") note.dir = NoteDir::LEFT;
+		else if (token == "right") note.dir = NoteDir::RIGHT;
+		else throw error("unknown direction '" + std::string(token) + "'.");
+
+		//coords go straight into points; times are filled in after the '@':
+		note.point_begin = uint32_t(points.size());
+		while (true) {
+			token = next_token();
+			if (token.empty()) throw error("expected '@' followed by hit times.");
+			if (token == "@") break;
+			Beatmap::Point point;
+			point.coord = read_float(token);
+			points.emplace_back(point);
+		}
+		note.point_end = uint32_t(points.size());
+
+		uint32_t count = note.point_end - note.point_begin;
+		if (count == 0) throw error("expected at least one coord before '@'.");
+		if (note.type != NoteType::HOLD && count != 1) throw error("single and burst notes take exactly one coord.");
+		if (note.type == NoteType::HOLD && count < 2) throw error("hold notes take at least two coords.");
+
+		for (uint32_t i = note.point_begin; i < note.point_end; ++i) {
+			token = next_token();
+			if (token.empty()) throw error("fewer times than coords.");
+			points[i].time = read_float(token);
+		}
+		token = next_token();
+		if (!token.empty()) throw error("more times than coords.");
+
+		notes.emplace_back(note);
+	}
+}
+
+void Beatmap::save(std::string const &filename) const {
+	std::ofstream file(filename, std::ios::binary);
+	write_chunk("bmn0", notes, &file);
+	write_chunk("bmp0", points, &file);
+	if (!file) {
+		throw std::runtime_error("Failed to write beatmap '" + filename + "'.");
+	}
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+/*
+ * A Beatmap holds the notes of one song's chart.
+ *
+ * Charts are written as text files in dist/beatmaps/, one note per line:
+ *   <type> <skin number> <direction> <coord begin> [<coord> ...] @ <time begin> [<time> ...]
+ *
+ * compile-beatmap converts these into '.beatc' files: a packed array of Note
+ *  records and a packed array of (already parsed) Points, each stored as a
+ *  read_chunk-style chunk. Loading a '.beatc' maps the file and copies the
+ *  two arrays out, so no text is parsed when a song starts.
+ *
+ */
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Note types
+enum NoteType : uint16_t {
+	SINGLE,
+	HOLD,
+	BURST,
+};
+
+// Border direction a note approaches from
+enum NoteDir : uint8_t {
+	UP,
+	DOWN,
+	LEFT,
+	RIGHT,
+};
+
+struct Beatmap {
+	//Notes are stored in order of their first hit time:
+	struct Note {
+		uint8_t type = SINGLE; //NoteType
+		uint8_t skin = 0; //mesh index within the active skin
+		uint8_t dir = UP; //NoteDir
+		uint8_t padding = 0;
+		uint32_t point_begin = 0; //range of this note's entries in 'points'
+		uint32_t point_end = 0;
+	};
+	static_assert(sizeof(Note) == 1 + 1 + 1 + 1 + 4 + 4, "Note is packed.");
+
+	//Position along the border (-1 to 1) that a note should reach at a given time:
+	// (single and burst notes have one point; hold notes have one per segment endpoint)
+	struct Point {
+		float coord = 0.0f;
+		float time = 0.0f; //hit time, in seconds since the song started
+	};
+	static_assert(sizeof(Point) == 4 + 4, "Point is packed.");
+
+	std::vector< Note > notes;
+	std::vector< Point > points;
+
+	//empty beatmap:
+	Beatmap() = default;
+
+	//load from a '.txt' chart or a compiled '.beatc' chart (chosen by extension):
+	// throws on file format errors
+	Beatmap(std::string const &filename);
+
+	//parse a chart in the text format from memory, appending to notes and points:
+	// 'source' names the chart in error messages (which give line and column)
+	void parse_text(std::string_view text, std::string const &source);
+
+	//write this beatmap in the compiled '.beatc' format:
+	void save(std::string const &filename) const;
+};
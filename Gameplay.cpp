@@ -0,0 +1,577 @@
+#include "Gameplay.hpp"
+
+#include <glm/gtx/quaternion.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+// float representing a small epsilon
+static float constexpr EPS_F = 0.0000001f;
+
+/*
+	Helper function that returns the world-to-local matrix of a note segment
+		Same as Scene::Transform::make_world_to_local for a transform without a parent
+		(computed here so Gameplay doesn't need Scene, which needs GL)
+*/
+static glm::mat4x3 make_world_to_local(glm::vec3 const &position, glm::quat const &rotation, glm::vec3 const &scale) {
+	glm::vec3 inv_scale;
+	//taking some care so that we don't end up with NaN's , just a degenerate matrix, if scale is zero:
+	inv_scale.x = (scale.x == 0.0f ? 0.0f : 1.0f / scale.x);
+	inv_scale.y = (scale.y == 0.0f ? 0.0f : 1.0f / scale.y);
+	inv_scale.z = (scale.z == 0.0f ? 0.0f : 1.0f / scale.z);
+
+	//compute inverse of rotation:
+	glm::mat3 inv_rot = glm::mat3_cast(glm::inverse(rotation));
+
+	//scale the rows of rot:
+	inv_rot[0] *= inv_scale;
+	inv_rot[1] *= inv_scale;
+	inv_rot[2] *= inv_scale;
+
+	return glm::mat4x3(
+		inv_rot[0],
+		inv_rot[1],
+		inv_rot[2],
+		inv_rot * -position
+	);
+}
+
+/*
+	Helper function that returns the world-space bounding box of a note segment's local bounds
+*/
+static void make_world_bounds(glm::vec3 const &position, glm::quat const &rotation, glm::vec3 const &scale, glm::vec3 const &min, glm::vec3 const &max, glm::vec3 *world_min, glm::vec3 *world_max) {
+	glm::mat3 local_to_world = glm::mat3_cast(rotation);
+	local_to_world[0] *= scale.x;
+	local_to_world[1] *= scale.y;
+	local_to_world[2] *= scale.z;
+
+	glm::vec3 center = position + local_to_world * (0.5f * (min + max));
+	glm::vec3 radius = 0.5f * (max - min);
+	glm::vec3 world_radius = glm::abs(local_to_world[0]) * radius.x + glm::abs(local_to_world[1]) * radius.y + glm::abs(local_to_world[2]) * radius.z;
+	*world_min = center - world_radius;
+	*world_max = center + world_radius;
+}
+
+/*
+	Helper function that returns the coordinates on the border given a direction and a value
+		Dir is the border the note approaches from
+		Coord should range from -1 to 1, going from left to right and bottom to top.
+*/
+glm::vec2 Gameplay::get_coords(NoteDir dir, float coord) const {
+	float x = 0.0f;
+	float y = 0.0f;
+	if (dir == NoteDir::LEFT) {
+		x = -x_scale;
+		y = coord;
+	} else if (dir == NoteDir::RIGHT) {
+		x = x_scale;
+		y = coord;
+	} else if (dir == NoteDir::UP) {
+		x = coord;
+		y = y_scale;
+	} else if (dir == NoteDir::DOWN) {
+		x = coord;
+		y = -y_scale;
+	}
+	return glm::vec2(x, y);
+}
+
+/*
+	Computes the placement every note segment of a beatmap starts each play at
+		*** Each note must have its time begin and end be less than the time begins of all notes after it ***
+*/
+void Gameplay::place_notes(Beatmap const &beatmap, std::vector<Placement> *placements_) const {
+	assert(placements_);
+	std::vector<Placement> &placements = *placements_;
+
+	placements.clear();
+	placements.reserve(beatmap.points.size());
+	for (auto const &entry : beatmap.notes) {
+		NoteDir dir = NoteDir(entry.dir);
+
+		if (entry.type == NoteType::HOLD) {
+			for (uint32_t i = entry.point_begin; i + 1 < entry.point_end; i++) {
+				float coord_begin = beatmap.points[i].coord;
+				float time_begin = beatmap.points[i].time;
+
+				float coord_end = beatmap.points[i+1].coord;
+				float time_end = beatmap.points[i+1].time;
+				glm::vec2 coords_begin = get_coords(dir, coord_begin);
+				glm::vec2 coords_end = get_coords(dir, coord_end);
+
+				Placement placement;
+				placement.position = glm::vec3((coords_begin.x + coords_end.x) / 2.0f, (coords_begin.y + coords_end.y) / 2.0f, init_note_depth - (time_end - time_begin) * note_speed / 2.0f);
+				float angle = 0.0f;
+				// if the xs are the same
+				if(dir == NoteDir::LEFT) {
+					angle = -atan2((coords_begin.y - coords_end.y), (time_end - time_begin) * note_speed);
+					placement.rotation = normalize(glm::angleAxis(angle, glm::vec3(1.0f, 0.0f, 0.0f)) * glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+				}
+				else if (dir == NoteDir::RIGHT) {
+					angle = -atan2((coords_begin.y - coords_end.y), (time_end - time_begin) * note_speed);
+					placement.rotation = normalize(glm::angleAxis(angle, glm::vec3(1.0f, 0.0f, 0.0f)) * (glm::quat(0.0f, 0.0f, 1.0f, 0.0f) * glm::quat(0.0f, 1.0f, 0.0f, 0.0f)));
+				}
+				else if (dir == NoteDir::UP) {
+					angle = atan2((coords_begin.x - coords_end.x), (time_end - time_begin) * note_speed);
+					placement.rotation = normalize(glm::angleAxis(angle, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::quat(0.7071f, 0.0f, 0.0f, -0.7071f));;
+				}
+				else {
+					angle = atan2((coords_begin.x - coords_end.x), (time_end - time_begin) * note_speed);
+					placement.rotation = normalize(glm::angleAxis(angle, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::quat(0.7071f, 0.0f, 0.0f, 0.7071f));;
+				}
+				placements.push_back(placement);
+			}
+		} else {
+			glm::vec2 coords = get_coords(dir, beatmap.points[entry.point_begin].coord);
+
+			Placement placement;
+			placement.position = glm::vec3(coords.x, coords.y, init_note_depth);
+			if(dir == NoteDir::LEFT) {
+				placement.rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+			}
+			else if (dir == NoteDir::RIGHT) {
+				placement.rotation = glm::quat(0.0f, 0.0f, 1.0f, 0.0f) * glm::quat(0.0f, 1.0f, 0.0f, 0.0f);
+			}
+			else if (dir == NoteDir::UP) {
+				placement.rotation = glm::quat(0.7071f, 0.0f, 0.0f, -0.7071f);
+			}
+			else {
+				placement.rotation = glm::quat(0.7071f, 0.0f, 0.0f, 0.7071f);
+			}
+			placements.push_back(placement);
+		}
+	}
+}
+
+/*
+	Resets all gameplay state to the start of a song
+		Every note segment goes back to its placement, invisible until its note spawns
+*/
+void Gameplay::start(NoteStore const &notes_, std::vector<Placement> const &placements, glm::vec3 const &camera_position_, bool is_tutorial_) {
+	assert(placements.size() == notes_.segment_count());
+
+	notes = notes_;
+	notes.reset();
+
+	note_spawn.resize(notes.size());
+	note_despawn.resize(notes.size());
+	for (uint32_t i = 0; i < notes.size(); i++) {
+		note_spawn[i] = notes.hit_begin[i] - note_approach_time;
+		note_despawn[i] = notes.hit_end[i] + valid_hit_time_delta;
+	}
+	note_window.build(note_spawn, note_despawn);
+	note_lanes.reset(notes.size(), std::max(x_scale, y_scale));
+
+	segment_position.resize(placements.size());
+	segment_rotation.resize(placements.size());
+	segment_scale.resize(placements.size());
+	for (uint32_t s = 0; s < placements.size(); s++) {
+		segment_position[s] = placements[s].position;
+		segment_rotation[s] = placements[s].rotation;
+	}
+	for (uint32_t i = 0; i < notes.size(); i++) {
+		for (uint32_t s = notes.segment_begin[i]; s < notes.segment_end[i]; s++) {
+			if (notes.type[i] == NoteType::HOLD) {
+				float duration = notes.segment_time_end[s] - notes.segment_time_begin[s];
+				segment_scale[s] = glm::vec3(0.5f, 0.5f, note_speed * duration / 4.0f);
+			} else {
+				segment_scale[s] = note_scale;
+			}
+		}
+	}
+
+	camera_position = camera_position_;
+	reset_cam();
+
+	steps = 0;
+	gun_mode = 0;
+	holding = false;
+	score = 0;
+	combo = 0;
+	max_combo = 0;
+	multiplier = 1;
+	health = 0.7f;
+	is_tutorial = is_tutorial_;
+	cleared = false;
+	failed = false;
+	events.clear();
+}
+
+void Gameplay::reset_cam() {
+	cam.azimuth = 0.0f;
+	cam.elevation = 3.1415926f / 2.0f;
+
+	camera_rotation =
+		normalize(glm::angleAxis(cam.azimuth, glm::vec3(0.0f, 1.0f, 0.0f))
+		* glm::angleAxis(0.5f * 3.1415926f + -cam.elevation, glm::vec3(1.0f, 0.0f, 0.0f)))
+	;
+}
+
+//-------------------------
+
+void Gameplay::record(ReplayLog::Input::Type type, float time, glm::vec2 xy, int change, int manual) {
+	if (!recording) return;
+	ReplayLog::Input input;
+	input.step = steps;
+	input.time = time;
+	input.type = type;
+	input.change = int8_t(change);
+	input.manual = int8_t(manual);
+	input.x = xy.x;
+	input.y = xy.y;
+	recording->inputs.emplace_back(input);
+}
+
+/*
+	Mouse motion: turns the camera (azimuth and elevation are clamped to look at the border)
+*/
+void Gameplay::aim(glm::vec2 delta, float time) {
+	advance(time);
+	record(ReplayLog::Input::Aim, time, delta);
+
+	cam.azimuth -= delta.x;
+	cam.elevation -= delta.y;
+
+	cam.azimuth /= 2.0f * 3.1415926f;
+	cam.azimuth = std::clamp(cam.azimuth - std::round(cam.azimuth), -0.05f, 0.05f);
+	cam.azimuth *= 2.0f * 3.1415926f;
+
+	cam.elevation /= 2.0f * 3.1415926f;
+	cam.elevation = std::clamp(cam.elevation - std::round(cam.elevation), 0.2f, 0.3f);
+	cam.elevation *= 2.0f * 3.1415926f;
+
+	//(azimuth is stretched by the aspect ratio the game was tuned at)
+	camera_rotation =
+		normalize(glm::angleAxis(1280.0f / 720.0f * cam.azimuth, glm::vec3(0.0f, 1.0f, 0.0f))
+		* glm::angleAxis(0.5f * 3.1415926f + -cam.elevation, glm::vec3(1.0f, 0.0f, 0.0f)));
+
+	if (holding) {
+		check_hit(time);
+	}
+}
+
+void Gameplay::press(float time) {
+	advance(time);
+	record(ReplayLog::Input::Press, time);
+	check_hit(time);
+	holding = true;
+}
+
+void Gameplay::release(float time) {
+	advance(time);
+	record(ReplayLog::Input::Release, time);
+	holding = false;
+	check_hit(time, false);
+}
+
+void Gameplay::check(float time) {
+	advance(time);
+	record(ReplayLog::Input::Check, time);
+	check_hit(time);
+}
+
+/*
+	Helper function to change gun firing mode
+		Takes effect at the current step (gun changes aren't judged, so they carry no time of their own)
+*/
+void Gameplay::change_gun(int idx_change, int manual_idx) {
+	assert(manual_idx != -1 || (idx_change == 1 || idx_change == -1));
+	record(ReplayLog::Input::Gun, step_music_time(), glm::vec2(0.0f), idx_change, manual_idx);
+
+	if (manual_idx != -1) {
+		gun_mode = manual_idx;
+	} else {
+		gun_mode += idx_change;
+		if (gun_mode == 3) gun_mode = 0;
+		else if (gun_mode == -1) gun_mode = 2;
+	}
+}
+
+/*
+	Applies a recorded input
+		The caller has already run the simulation to input.step, so the advance() inside each input does nothing
+		(that advance() is what stopped the recorded simulation at input.step in the first place)
+*/
+void Gameplay::apply(ReplayLog::Input const &input) {
+	assert(input.step == steps || failed);
+
+	ReplayLog *was_recording = recording;
+	recording = nullptr;
+	switch (input.type) {
+		case ReplayLog::Input::Aim: aim(glm::vec2(input.x, input.y), input.time); break;
+		case ReplayLog::Input::Press: press(input.time); break;
+		case ReplayLog::Input::Release: release(input.time); break;
+		case ReplayLog::Input::Check: check(input.time); break;
+		case ReplayLog::Input::Gun: change_gun(input.change, input.manual); break;
+	}
+	recording = was_recording;
+}
+
+//-------------------------
+
+void Gameplay::advance(float music_time) {
+	while (!failed && (steps + 1) * StepTime <= music_time) {
+		step();
+	}
+}
+
+void Gameplay::step_to(uint32_t target) {
+	while (!failed && steps < target) {
+		step();
+	}
+}
+
+void Gameplay::step() {
+	if (failed) return;
+	steps += 1;
+	update_notes();
+	if (recording && steps % CheckpointSteps == 0) checkpoint();
+}
+
+void Gameplay::checkpoint() {
+	if (!recording) return;
+	ReplayLog::Checkpoint checkpoint;
+	checkpoint.step = steps;
+	checkpoint.score = score;
+	checkpoint.combo = combo;
+	checkpoint.max_combo = max_combo;
+	checkpoint.health = health;
+	recording->checkpoints.emplace_back(checkpoint);
+}
+
+/*
+	We maintain the notes to be checked with note_window (see ActiveWindow.hpp):
+		Notes are admitted (spawned) note_approach_time before their first hit time and
+		retired valid_hit_time_delta after their last hit time. A note that was hit
+		gets the BeenHit flag but stays live until it retires (a hit single or burst
+		note stops where it was hit, showing its "hit" mesh for hit_show_time).
+
+	Steps only do work when notes spawn or retire: positions are a function of the
+	song time (see segment_position_at), so nothing moves notes each step.
+
+	Retiring a note that was never hit counts as a miss; once every note has
+	retired the song is cleared.
+*/
+void Gameplay::update_notes() {
+	float music_time = step_music_time();
+
+	if (!is_tutorial) {
+		health = std::max(0.0f, health - StepTime / 50.0f);
+	}
+	if (health < EPS_F) {
+		failed = true;
+		return;
+	}
+
+	note_window.advance(music_time, [&](uint32_t i) {
+		// spawn the note
+		notes.state[i] |= NoteStore::Active;
+
+		// notes only move along z from here on, so their place in note_lanes is fixed
+		uint32_t head = notes.segment_begin[i];
+		glm::vec3 min, max;
+		make_world_bounds(segment_position[head], segment_rotation[head], segment_scale[head], notes.min[i], notes.max[i], &min, &max);
+		note_lanes.insert(i, notes.lane[i], min, max);
+
+		events.emplace_back(Event{Event::Spawn, int(i), 0});
+	}, [&](uint32_t i) {
+		// 'delete' the note
+		if (!(notes.state[i] & NoteStore::BeenHit)) hit_note(-1, -1);
+		notes.state[i] &= ~NoteStore::Active;
+		note_lanes.remove(i);
+		events.emplace_back(Event{Event::Retire, int(i), 0});
+	});
+
+	if (note_window.finished()) cleared = true;
+}
+
+/*
+	Position of a note segment at a song time
+		Notes move from init_note_depth towards the player at note_speed, each hold segment by its own begin time
+		(a hit single or burst note stays where it was at its stop_time)
+*/
+glm::vec3 Gameplay::segment_position_at(uint32_t note, uint32_t s, float music_time) const {
+	float delta_time = std::min(music_time, notes.stop_time[note]) - (notes.segment_time_begin[s] - note_approach_time);
+	glm::vec3 position = segment_position[s];
+	position.z = init_note_depth + note_speed * delta_time;
+	return position;
+}
+
+
+/*
+	Helper function to trace a ray from pos in dir direction against every visible note
+		Hold notes are tested against their first segment and stay hittable after being hit (so they can be held)
+		Only the notes note_lanes finds near the ray are tested (check_hit can run on every mouse motion event)
+		Returns the nearest note hit
+*/
+HitInfo Gameplay::trace_ray(glm::vec3 pos, glm::vec3 dir) {
+	// (candidates come in note order, the same order the live notes were all tested in before)
+	note_lanes.query(pos, dir, &note_candidates);
+	note_bounds.clear();
+	for (uint32_t i : note_candidates) {
+		uint32_t s = notes.segment_begin[i];
+		note_bounds.add(i, make_world_to_local(segment_position_at(i, s, step_music_time()), segment_rotation[s], segment_scale[s]), notes.min[i], notes.max[i]);
+	}
+
+	HitInfo hits;
+	uint32_t note = 0;
+	if (note_bounds.nearest(pos, dir, &note, &hits.time)) {
+		hits.note = int(note);
+	}
+	return hits;
+}
+
+void Gameplay::set_combo(int diff) {
+	combo += diff;
+	multiplier = combo / 25 + 1;
+	if (combo > max_combo) max_combo = combo;
+}
+
+/*
+	Update function to a note, score / combo and health
+		Reports the judgement in events, so PlayMode can play its sound and show its "hit" mesh
+*/
+void Gameplay::hit_note(int note_idx, int hit_status) {
+	events.emplace_back(Event{Event::Judge, note_idx, hit_status});
+
+	if (hit_status == -1) {
+		set_combo(-combo);
+		if (is_tutorial) return;
+		health = std::max(0.0f, health - 0.1f);
+		if (health < EPS_F) failed = true;
+		return;
+	}
+
+	// deactivate the note
+	notes.state[note_idx] |= NoteStore::BeenHit;
+	// hold notes stay hittable after being hit (so they can be held); other notes stop where they are
+	if (notes.type[note_idx] != NoteType::HOLD) {
+		note_lanes.remove(note_idx);
+		notes.stop_time[note_idx] = step_music_time();
+	}
+
+	switch (hit_status) {
+		case 0:
+			// bad hit, same as miss
+			set_combo(-combo);
+			if (!is_tutorial) {
+				health = std::max(0.0f, health - 0.1f);
+				if (health < EPS_F) failed = true;
+			}
+			break;
+		case 1:
+			// good hit
+			score += 50 * multiplier;
+			set_combo(1);
+			health = std::min(max_health, health + 0.03f);
+			break;
+		case 2:
+			// perfect hit
+			score += 100 * multiplier;
+			set_combo(1);
+			health = std::min(max_health, health + 0.03f);
+			break;
+		case 3:
+			// wrong gun hit
+			score += 10 * multiplier;
+			set_combo(-combo);
+			break;
+		case 4:
+			// hold begin and end
+			score += 10 * multiplier;
+			set_combo(1);
+			health = std::min(max_health, health + 0.03f);
+			break;
+		case 5:
+			// hold during success
+			score += 1 * multiplier;
+			set_combo(1);
+			health = std::min(max_health, health + 0.0003f);
+			break;
+		case 6:
+			// hold during fail
+			set_combo(-combo);
+			if (is_tutorial) {
+				health = std::max(0.0f, health - 0.0003f);
+			}
+			break;
+	}
+}
+
+/*
+	Function called whenever we click on the screen
+		Checks if we hit any note, see if the hit is valid or not and then calls hit note based on that
+		music_time is the song position when the input happened
+*/
+void Gameplay::check_hit(float music_time, bool mouse_down) {
+	if (failed) return;
+
+	// ray from camera position to origin (p1 - p2)
+	glm::vec3 ray = glm::vec3(0) - camera_position;
+	// rotate ray to get the direction from camera
+	ray = glm::normalize(glm::rotate(camera_rotation, ray));
+	// trace the ray to see if we hit a note
+	HitInfo hits = trace_ray(camera_position, ray);
+
+	// if we hit a note, check to see if we hit a good time
+	if(hits.note != -1) {
+		int i = hits.note;
+		if(notes.type[i] == NoteType::HOLD) {
+			// only considers first 0.2 seconds of the hold -> need to change
+			if(fabs(music_time - notes.hit_begin[i]) < valid_hit_time_delta && !holding && mouse_down) {
+				// initial click
+				hit_note(i, 4);
+			}
+			else if(fabs(notes.hit_end[i] - music_time) < valid_hit_time_delta && !holding && !mouse_down) {
+				// release near the end
+				hit_note(i, 4);
+			}
+			else if (holding) {
+				// holding in between note
+				// want to do linear interpolation between the hit_times depending on how fast the note is approaching
+				glm::vec2 coord = get_coords(notes.lane[i], notes.coord_begin[i] + (music_time - notes.hit_begin[i] + real_song_offset) * (notes.coord_end[i] - notes.coord_begin[i]) / (notes.hit_end[i] - notes.hit_begin[i]));
+
+				uint32_t s = notes.segment_begin[i];
+				glm::mat4 inverse = make_world_to_local(segment_position_at(i, s, step_music_time()), segment_rotation[s], segment_scale[s]);
+				glm::vec3 start = glm::vec3(inverse * glm::vec4(camera_position, 1.0f));
+				glm::vec3 end = glm::vec3(inverse * glm::vec4(coord.x, coord.y, border_depth, 1.0f));
+				float dist = glm::distance(start, end);
+				if(gun_mode == 2 && dist - 0.5 < hits.time && hits.time < dist + 0.5) {
+					hit_note(i, 5);
+				}
+				else {
+					hit_note(i, 6);
+				}
+			}
+		}
+		else {
+			if (holding || !mouse_down) return; // don't allow mouse LMB down hold cheese or lifting mouse button up
+
+			bool right_gun = (gun_mode == 0 && notes.type[i] == NoteType::SINGLE) || (gun_mode == 1 && notes.type[i] == NoteType::BURST);
+			// valid hit time for single and burst
+			if(fabs(music_time - notes.hit_begin[i]) < valid_hit_time_delta / 2.0f) {
+				// good hit
+				if (right_gun){
+					hit_note(i, 2);
+				} else {
+					hit_note(i, 3);
+				}
+			} else if (fabs(music_time - notes.hit_begin[i]) < valid_hit_time_delta) {
+				// ok hit
+				if (right_gun){
+					hit_note(i, 1);
+				} else {
+					hit_note(i, 3);
+				}
+			}
+			else {
+				// bad hit
+				hit_note(i, 0);
+			}
+		}
+	}
+	else {
+		// miss
+	}
+}
@@ -0,0 +1,166 @@
+#pragma once
+
+/*
+ * Gameplay holds the rules of a song -- moving notes, aiming, judging hits,
+ *  score / combo / health -- without any rendering, audio or SDL, so the same
+ *  code runs in the game and headless (see replay-gameplay).
+ *
+ * The simulation advances in fixed steps of StepTime along the song timeline:
+ *  advance(music_time) runs however many steps the music clock has moved, and
+ *  inputs are applied between steps (each judged at the song time it happened).
+ *  So a play is fully determined by its inputs and the steps they were applied
+ *  at, which is exactly what gets written to 'recording' (a ReplayLog) if set.
+ *
+ * PlayMode owns a Gameplay: it feeds it inputs from handle_event and the music
+ *  clock from update, draws the notes from their placements, and turns
+ *  'events' into sounds, "hit" meshes and the game over screen.
+ *
+ */
+
+#include "Beatmap.hpp"
+#include "NoteStore.hpp"
+#include "ActiveWindow.hpp"
+#include "NoteBounds.hpp"
+#include "LaneIndex.hpp"
+#include "ReplayLog.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// struct for intersection functions
+struct HitInfo {
+	int note = -1; // index into Gameplay::notes, or -1 for no hit
+	float time = 0.0f;
+};
+
+struct Gameplay {
+	//----- settings -----
+	static constexpr float StepTime = 1.0f / 240.0f; // length of one simulation step (in seconds of song time)
+	static constexpr uint32_t CheckpointSteps = 240; // steps between checkpoints written to the recording
+
+	// TODO : should include some scaling variable to allow for different note speed settings to automatically affect these
+	float init_note_depth = -20.0f;
+	// TODO : this is different from the border that is being visually displayed?
+	float border_depth = 0.0f;
+	float x_scale = 1.0f;
+	float y_scale = 1.0f;
+
+	glm::vec3 note_scale = glm::vec3(0.2f, 0.2f, 0.2f);
+	float note_approach_time = 4.0f; // time between when the note shows up and hit time
+	float hit_show_time = 0.5f; // time a hit single or burst note keeps showing its "hit" mesh (after its stop_time)
+	float valid_hit_time_delta = 0.5f;
+	float real_song_offset = 0.00f;
+	float note_speed = (border_depth - init_note_depth) / note_approach_time;
+
+	float max_health = 1.0f;
+
+	//----- setup -----
+	// placement each note segment starts each play at
+	struct Placement {
+		glm::vec3 position;
+		glm::quat rotation;
+	};
+	// compute the starting placement of every segment of a beatmap's notes (only reads settings, so safe on any thread)
+	void place_notes(Beatmap const &beatmap, std::vector<Placement> *placements) const;
+	glm::vec2 get_coords(NoteDir dir, float coord) const;
+
+	// start a song: placements has one entry per segment
+	//  (notes.min/max are copied too; they may also be filled in on 'notes' after start, before the first step)
+	//  once the vectors have grown to fit a song, restarting it doesn't allocate
+	void start(NoteStore const &notes, std::vector<Placement> const &placements, glm::vec3 const &camera_position, bool is_tutorial);
+	void reset_cam();
+
+	//----- inputs -----
+	// each takes the song time it happened at, catches the simulation up to that time,
+	// applies the input, and appends it to 'recording' (if set)
+	void aim(glm::vec2 delta, float time); // mouse motion, already scaled by sensitivity
+	void press(float time); // mouse button down
+	void release(float time); // mouse button up
+	void check(float time); // hit key, or any other event while holding
+	void change_gun(int idx_change, int manual_idx = -1);
+
+	// apply a recorded input (at the current step, without recording it again)
+	void apply(ReplayLog::Input const &input);
+
+	//----- simulation -----
+	// run every step up to music_time
+	void advance(float music_time);
+	// run steps until 'steps' reaches target (or the song is failed)
+	void step_to(uint32_t target);
+	void step();
+
+	// append the current score / combo / health to the recording
+	void checkpoint();
+
+	//----- state -----
+	uint32_t steps = 0; // steps run since start
+	float step_music_time() const { return steps * StepTime; }
+
+	// notes of the current song and their live window
+	NoteStore notes;
+	ActiveWindow note_window;
+	// notes trace_ray can hit, by lane and coordinate (added when they spawn, removed when hit or retired)
+	LaneIndex note_lanes;
+	// boxes of the notes near the ray, gathered from note_lanes by each trace_ray
+	NoteBounds note_bounds;
+	std::vector<uint32_t> note_candidates;
+
+	// pose of every note segment (index == segment)
+	// notes only move along z, as a function of song time, so segment_position keeps the placement and
+	// the position at any time is computed when it's needed (by trace_ray, and by PlayMode when drawing)
+	std::vector<glm::vec3> segment_position;
+	std::vector<glm::quat> segment_rotation;
+	std::vector<glm::vec3> segment_scale; // fixed for the song: whether a note is shown / hittable is NoteStore::Active (and note_lanes), not its scale
+	glm::vec3 segment_position_at(uint32_t note, uint32_t segment, float music_time) const;
+
+	// camera (only rotates)
+	glm::vec3 camera_position = glm::vec3(0.0f);
+	glm::quat camera_rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+	// from ShowSceneMode.hpp to fix the up axis
+	struct {
+		float azimuth = 0.0f; //angle ccw of -y axis, in radians, [-pi,pi]
+		float elevation = 3.1415926f / 2.0f; //angle above ground, in radians, [-pi,pi]
+	} cam;
+
+	int gun_mode = 0; // 0 = single, 1 = burst, 2 = hold
+	// variable to keep track if mouse click is being held down
+	bool holding = false;
+
+	int score = 0;
+	int combo = 0;
+	int max_combo = 0;
+	int multiplier = 1;
+	float health = 0.7f;
+
+	bool is_tutorial = false;
+	bool cleared = false; // every note has retired
+	bool failed = false; // health ran out (no more steps run)
+
+	// things that happened since PlayMode last cleared this, for it to present
+	struct Event {
+		enum Type : uint8_t {
+			Spawn, // note appeared
+			Judge, // note was judged with status (note is -1 for a note that retired unhit)
+			Retire, // note left the live window (and is hidden)
+		} type;
+		int note = -1;
+		int status = 0;
+	};
+	std::vector<Event> events;
+
+	// inputs and checkpoints are appended here if not null
+	ReplayLog *recording = nullptr;
+
+	//----- internals -----
+	// intersection functions to hit notes
+	HitInfo trace_ray(glm::vec3 pos, glm::vec3 dir);
+	void check_hit(float music_time, bool mouse_down = true);
+	void set_combo(int diff);
+	void hit_note(int note_idx, int hit_status);
+	void update_notes();
+	std::vector<float> note_spawn, note_despawn; // (kept to reuse their storage in start)
+	void record(ReplayLog::Input::Type type, float time, glm::vec2 xy = glm::vec2(0.0f), int change = 0, int manual = -1);
+};
@@ -0,0 +1,120 @@
+#include "LaneIndex.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+//ray ranges are widened by this much, so rounding never drops a box the ray only grazes:
+static float constexpr Pad = 0.001f;
+
+void LaneIndex::reset(uint32_t note_count, float extent_) {
+	assert(extent_ > 0.0f);
+	extent = extent_;
+
+	for (uint32_t l = 0; l < lanes.size(); ++l) {
+		Lane &lane = lanes[l];
+		//left and right lanes run along y, up and down lanes along x:
+		lane.across = (l == NoteDir::LEFT || l == NoteDir::RIGHT ? 0 : 1);
+		lane.along = 1 - lane.across;
+		lane.across_min = lane.across_max = 0.0f;
+		lane.empty = true;
+		for (auto &b : lane.buckets) b.clear();
+	}
+
+	entries.assign(note_count, Entry());
+	count = 0;
+}
+
+uint32_t LaneIndex::bucket(float coord) const {
+	float f = (coord + extent) / (2.0f * extent) * Buckets;
+	if (!(f > 0.0f)) return 0; //(also catches NaN)
+	if (f >= float(Buckets)) return Buckets - 1;
+	return uint32_t(f);
+}
+
+void LaneIndex::insert(uint32_t note, NoteDir lane_, glm::vec3 const &min, glm::vec3 const &max) {
+	assert(note < entries.size());
+	assert(uint32_t(lane_) < lanes.size());
+	remove(note);
+
+	Lane &lane = lanes[lane_];
+	if (lane.empty) {
+		lane.across_min = min[lane.across];
+		lane.across_max = max[lane.across];
+		lane.empty = false;
+	} else {
+		lane.across_min = std::min(lane.across_min, min[lane.across]);
+		lane.across_max = std::max(lane.across_max, max[lane.across]);
+	}
+
+	Entry &entry = entries[note];
+	entry.lane = uint8_t(lane_);
+	entry.bucket_begin = uint8_t(bucket(min[lane.along]));
+	entry.bucket_end = uint8_t(bucket(max[lane.along]) + 1);
+	for (uint32_t b = entry.bucket_begin; b < entry.bucket_end; ++b) {
+		lane.buckets[b].emplace_back(note);
+	}
+	count += 1;
+}
+
+void LaneIndex::remove(uint32_t note) {
+	assert(note < entries.size());
+	Entry &entry = entries[note];
+	if (entry.bucket_begin == entry.bucket_end) return;
+
+	Lane &lane = lanes[entry.lane];
+	for (uint32_t b = entry.bucket_begin; b < entry.bucket_end; ++b) {
+		std::vector< uint32_t > &bucket = lane.buckets[b];
+		auto at = std::find(bucket.begin(), bucket.end(), note);
+		assert(at != bucket.end());
+		*at = bucket.back();
+		bucket.pop_back();
+	}
+	entry.bucket_end = entry.bucket_begin;
+	count -= 1;
+}
+
+void LaneIndex::query(glm::vec3 const &pos, glm::vec3 const &dir, std::vector< uint32_t > *notes_) const {
+	assert(notes_);
+	std::vector< uint32_t > &notes = *notes_;
+	notes.clear();
+
+	float const inf = std::numeric_limits< float >::infinity();
+	for (Lane const &lane : lanes) {
+		if (lane.empty) continue;
+
+		//part of the ray (t >= 0) within the range the lane's boxes cover across it:
+		float t0 = 0.0f;
+		float t1 = inf;
+		float p = pos[lane.across];
+		float d = dir[lane.across];
+		float lo = lane.across_min - Pad;
+		float hi = lane.across_max + Pad;
+		if (d != 0.0f) {
+			float ta = (lo - p) / d;
+			float tb = (hi - p) / d;
+			t0 = std::max(t0, std::min(ta, tb));
+			t1 = std::min(t1, std::max(ta, tb));
+		} else if (p < lo || p > hi) {
+			continue;
+		}
+		if (t0 > t1) continue;
+
+		//...and where that part runs along the lane:
+		float a0 = pos[lane.along] + dir[lane.along] * t0;
+		float a1 = pos[lane.along];
+		if (t1 != inf) a1 += dir[lane.along] * t1;
+		else if (dir[lane.along] > 0.0f) a1 = inf;
+		else if (dir[lane.along] < 0.0f) a1 = -inf;
+
+		uint32_t begin = bucket(std::min(a0, a1) - Pad);
+		uint32_t end = bucket(std::max(a0, a1) + Pad) + 1;
+		for (uint32_t b = begin; b < end; ++b) {
+			notes.insert(notes.end(), lane.buckets[b].begin(), lane.buckets[b].end());
+		}
+	}
+
+	//(boxes spanning several buckets are found more than once)
+	std::sort(notes.begin(), notes.end());
+	notes.erase(std::unique(notes.begin(), notes.end()), notes.end());
+}
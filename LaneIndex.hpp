@@ -0,0 +1,68 @@
+#pragma once
+
+/*
+ * A LaneIndex buckets the notes that can be hit by the lane (border side) they
+ *  approach from and by their coordinate along that lane, so a crosshair ray
+ *  only needs testing against the notes near where it crosses each lane.
+ *
+ * Notes only move towards the player (along z), so the extent of a note's box
+ *  across and along its lane doesn't change while it is live: a note is
+ *  inserted once when it spawns and removed when it is hit or retires.
+ *
+ * Each lane also keeps the range its boxes cover across the lane (e.g. x for
+ *  the left and right lanes), which bounds where a ray can reach those boxes;
+ *  query() returns the notes of every bucket the ray passes over within that
+ *  range. That is a superset of the notes the ray hits, so tracing against
+ *  just those gives the same nearest hit as tracing against all of them.
+ *
+ */
+
+#include "Beatmap.hpp"
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+struct LaneIndex {
+	static constexpr uint32_t Buckets = 16; //per lane, over [-extent, extent] along the lane
+
+	//empty the index (keeping storage) for a song of note_count notes:
+	// coordinates outside [-extent, extent] go in the end buckets
+	void reset(uint32_t note_count, float extent);
+
+	//add a note with its world-space bounding box (from the lane it approaches from):
+	void insert(uint32_t note, NoteDir lane, glm::vec3 const &min, glm::vec3 const &max);
+	//remove a note (does nothing if it isn't in the index):
+	void remove(uint32_t note);
+
+	//notes whose boxes the ray from pos along dir may hit, in increasing order (replaces *notes):
+	void query(glm::vec3 const &pos, glm::vec3 const &dir, std::vector< uint32_t > *notes) const;
+
+	uint32_t size() const { return count; }
+
+	//----- internals -----
+	struct Lane {
+		uint32_t across = 0; //axis across the lane (0 = x, 1 = y)
+		uint32_t along = 1; //axis along the lane
+		float across_min = 0.0f; //range covered across the lane by every box inserted since reset
+		float across_max = 0.0f;
+		bool empty = true;
+		std::array< std::vector< uint32_t >, Buckets > buckets;
+	};
+	std::array< Lane, 4 > lanes; //indexed by NoteDir
+
+	//where each note was inserted:
+	struct Entry {
+		uint8_t lane = 0;
+		uint8_t bucket_begin = 0;
+		uint8_t bucket_end = 0; //bucket_begin == bucket_end when not in the index
+	};
+	std::vector< Entry > entries;
+
+	float extent = 1.0f;
+	uint32_t count = 0;
+
+	uint32_t bucket(float coord) const;
+};
@@ -3,6 +3,12 @@
 #include "gl_compile_program.hpp"
 #include "gl_errors.hpp"
 
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+
 // changed based on lighting class demo
 
 Scene::Drawable::Pipeline lit_color_texture_program_pipeline;
@@ -10,20 +16,23 @@ Scene::Drawable::Pipeline lit_color_texture_program_pipeline;
 Load< LitColorTextureProgram > lit_color_texture_program(LoadTagEarly, []() -> LitColorTextureProgram const * {
 	LitColorTextureProgram *ret = new LitColorTextureProgram();
 
+	//make the light block's buffer (starting with no lights) and attach it to its binding point:
+	// (variants all read this same buffer)
+	glGenBuffers(1, &ret->lights_buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, ret->lights_buffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(LitColorTextureProgram::LightBlock), &ret->uploaded_lights, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	glBindBufferBase(GL_UNIFORM_BUFFER, LitColorTextureProgram::LightsBinding, ret->lights_buffer);
+
 	//----- build the pipeline template -----
-	lit_color_texture_program_pipeline.program = ret->program;
+	Scene::Material material;
+	material.program = ret->program;
 
-	lit_color_texture_program_pipeline.OBJECT_TO_CLIP_mat4 = ret->OBJECT_TO_CLIP_mat4;
-	lit_color_texture_program_pipeline.OBJECT_TO_LIGHT_mat4x3 = ret->OBJECT_TO_LIGHT_mat4x3;
-	lit_color_texture_program_pipeline.NORMAL_TO_LIGHT_mat3 = ret->NORMAL_TO_LIGHT_mat3;
+	material.OBJECT_TO_CLIP_mat4 = ret->OBJECT_TO_CLIP_mat4;
+	material.OBJECT_TO_LIGHT_mat4x3 = ret->OBJECT_TO_LIGHT_mat4x3;
+	material.NORMAL_TO_LIGHT_mat3 = ret->NORMAL_TO_LIGHT_mat3;
 
-	/* This will be used later if/when we build a light loop into the Scene:
-	lit_color_texture_program_pipeline.LIGHT_TYPE_int = ret->LIGHT_TYPE_int;
-	lit_color_texture_program_pipeline.LIGHT_LOCATION_vec3 = ret->LIGHT_LOCATION_vec3;
-	lit_color_texture_program_pipeline.LIGHT_DIRECTION_vec3 = ret->LIGHT_DIRECTION_vec3;
-	lit_color_texture_program_pipeline.LIGHT_ENERGY_vec3 = ret->LIGHT_ENERGY_vec3;
-	lit_color_texture_program_pipeline.LIGHT_CUTOFF_float = ret->LIGHT_CUTOFF_float;
-	*/
+	//(lights aren't part of the material: they come from the shared light block, see set_lights)
 
 	//make a 1-pixel white texture to bind by default:
 	GLuint tex;
@@ -39,13 +48,185 @@ Load< LitColorTextureProgram > lit_color_texture_program(LoadTagEarly, []() -> L
 	glBindTexture(GL_TEXTURE_2D, 0);
 
 
-	lit_color_texture_program_pipeline.textures[0].texture = tex;
-	lit_color_texture_program_pipeline.textures[0].target = GL_TEXTURE_2D;
+	material.textures[0].texture = tex;
+	material.textures[0].target = GL_TEXTURE_2D;
+
+	lit_color_texture_program_pipeline.material = Scene::intern_material(material);
 
 	return ret;
 });
 
-LitColorTextureProgram::LitColorTextureProgram() {
+//local (to this file) cache of compiled variants:
+namespace {
+	std::unordered_map< uint32_t, LitColorTextureProgram const * > &variants() {
+		static std::unordered_map< uint32_t, LitColorTextureProgram const * > map;
+		return map;
+	}
+
+	uint32_t light_type_index(Scene::Light::Type type) {
+		using LightBlock = LitColorTextureProgram::LightBlock;
+		if (type == Scene::Light::Point) return LightBlock::Point;
+		else if (type == Scene::Light::Hemisphere) return LightBlock::Hemisphere;
+		else if (type == Scene::Light::Spot) return LightBlock::Spot;
+		else if (type == Scene::Light::Directional) return LightBlock::Directional;
+		else {
+			throw std::runtime_error("Unknown light type '" + std::string(1, char(type)) + "'.");
+		}
+	}
+}
+
+std::string LitColorTextureProgram::Variant::defines() const {
+	std::string ret;
+	if (fixed) {
+		ret += "#define FIXED_LIGHTS\n";
+		ret += "#define POINT_LIGHTS " + std::to_string(point) + "\n";
+		ret += "#define HEMISPHERE_LIGHTS " + std::to_string(hemisphere) + "\n";
+		ret += "#define SPOT_LIGHTS " + std::to_string(spot) + "\n";
+		ret += "#define DIRECTIONAL_LIGHTS " + std::to_string(directional) + "\n";
+	}
+	if (!textured) ret += "#define UNTEXTURED\n";
+	return ret;
+}
+
+uint32_t LitColorTextureProgram::Variant::key() const {
+	static_assert(MaxLights < 16, "Light counts fit in four bits.");
+	if (!fixed) return uint32_t(textured);
+	return uint32_t(textured) | (1U << 1)
+		| (uint32_t(point) << 4) | (uint32_t(hemisphere) << 8)
+		| (uint32_t(spot) << 12) | (uint32_t(directional) << 16);
+}
+
+LitColorTextureProgram::Variant LitColorTextureProgram::Variant::for_lights(SlotMap< Scene::Light > const &lights) {
+	//(counts the same lights set_lights uploads: the first MaxLights)
+	uint8_t counts[LightBlock::TypeCount] = {0, 0, 0, 0};
+	uint32_t total = 0;
+	for (Scene::Light const &light : lights) {
+		if (total == MaxLights) break;
+		counts[light_type_index(light.type)] += 1;
+		total += 1;
+	}
+	Variant ret;
+	ret.fixed = true;
+	ret.point = counts[LightBlock::Point];
+	ret.hemisphere = counts[LightBlock::Hemisphere];
+	ret.spot = counts[LightBlock::Spot];
+	ret.directional = counts[LightBlock::Directional];
+	return ret;
+}
+
+LitColorTextureProgram const &LitColorTextureProgram::get_variant(Variant const &variant) {
+	auto f = variants().find(variant.key());
+	if (f != variants().end()) return *f->second;
+	//(the base program is already compiled, no need for another copy)
+	if (variant.key() == Variant().key()) return *lit_color_texture_program;
+
+	LitColorTextureProgram const *ret = new LitColorTextureProgram(variant);
+	variants().emplace(variant.key(), ret);
+	return *ret;
+}
+
+void LitColorTextureProgram::specialize(Scene::Drawable::Pipeline *pipeline, SlotMap< Scene::Light > const &lights) {
+	assert(pipeline);
+	Scene::Material material = Scene::material(pipeline->material);
+	Variant variant = Variant::for_lights(lights);
+	Scene::Material::TextureInfo const &white = Scene::material(lit_color_texture_program_pipeline.material).textures[0];
+	variant.textured = !(material.textures[0].texture == white.texture && material.textures[0].target == white.target);
+
+	LitColorTextureProgram const &program = get_variant(variant);
+	material.program = program.program;
+	material.OBJECT_TO_CLIP_mat4 = program.OBJECT_TO_CLIP_mat4;
+	material.OBJECT_TO_LIGHT_mat4x3 = program.OBJECT_TO_LIGHT_mat4x3;
+	material.NORMAL_TO_LIGHT_mat3 = program.NORMAL_TO_LIGHT_mat3;
+	pipeline->material = Scene::intern_material(material);
+}
+
+//(NoteProgram lights notes with this same fragment shader)
+std::string LitColorTextureProgram::fragment_shader() {
+	//with FIXED_LIGHTS, light k of each type gets its own #if block, so the driver sees straight-line code:
+	std::string fixed_lights;
+	auto unroll = [&](char const *count, char const *first, char const *function) {
+		for (uint32_t k = 0; k < MaxLights; ++k) {
+			fixed_lights +=
+				"#if " + std::string(count) + " > " + std::to_string(k) + "\n"
+				"	total += " + function + "(LIGHT[" + first + std::to_string(k) + "], n);\n"
+				"#endif\n";
+		}
+	};
+	unroll("POINT_LIGHTS", "", "point_light");
+	unroll("HEMISPHERE_LIGHTS", "POINT_LIGHTS + ", "hemisphere_light");
+	unroll("SPOT_LIGHTS", "POINT_LIGHTS + HEMISPHERE_LIGHTS + ", "spot_light");
+	unroll("DIRECTIONAL_LIGHTS", "POINT_LIGHTS + HEMISPHERE_LIGHTS + SPOT_LIGHTS + ", "directional_light");
+
+	return
+		"#version 330\n"
+		"uniform sampler2D TEX;\n"
+		"struct Light {\n" //(laid out as LightBlock::Light)
+		"	vec3 LOCATION;\n"
+		"	vec3 DIRECTION;\n"
+		"	float CUTOFF;\n"
+		"	vec3 ENERGY;\n"
+		"};\n"
+		"layout(std140) uniform Lights {\n"
+		"	uvec4 LIGHT_COUNTS; //point, hemisphere, spot, directional\n"
+		"	Light LIGHT[" + std::to_string(MaxLights) + "]; //grouped by type, in the same order\n"
+		"};\n"
+		"in vec3 position;\n"
+		"in vec3 normal;\n"
+		"in vec4 color;\n"
+		"in vec2 texCoord;\n"
+		"out vec4 fragColor;\n"
+		"vec3 point_light(Light L, vec3 n) {\n"
+		"	vec3 l = (L.LOCATION - position);\n"
+		"	float dis2 = dot(l,l);\n"
+		"	l = normalize(l);\n"
+		"	float nl = max(0.0, dot(n, l)) / max(1.0, dis2);\n"
+		"	return nl * L.ENERGY;\n"
+		"}\n"
+		"vec3 hemisphere_light(Light L, vec3 n) {\n"
+		"	return (dot(n,-L.DIRECTION) * 0.5 + 0.5) * L.ENERGY;\n"
+		"}\n"
+		"vec3 spot_light(Light L, vec3 n) {\n"
+		"	vec3 l = (L.LOCATION - position);\n"
+		"	float dis2 = dot(l,l);\n"
+		"	l = normalize(l);\n"
+		"	float nl = max(0.0, dot(n, l)) / max(1.0, dis2);\n"
+		"	float c = dot(l,-L.DIRECTION);\n"
+		"	nl *= smoothstep(L.CUTOFF,mix(L.CUTOFF,1.0,0.1), c);\n"
+		"	return nl * L.ENERGY;\n"
+		"}\n"
+		"vec3 directional_light(Light L, vec3 n) {\n"
+		"	return max(0.0, dot(n,-L.DIRECTION)) * L.ENERGY;\n"
+		"}\n"
+		"void main() {\n"
+		"	vec3 n = normalize(normal);\n"
+		"#ifdef UNTEXTURED\n"
+		"	vec4 albedo = color;\n"
+		"#else\n"
+		"	vec4 albedo = texture(TEX, texCoord) * color;\n"
+		"#endif\n"
+		"	vec3 total = vec3(0.0f); //total light energy arriving\n"
+		"#ifdef FIXED_LIGHTS\n"
+		+ fixed_lights +
+		"#else\n"
+		"	uint first = 0u;\n"
+		"	for (uint light = 0u; light < LIGHT_COUNTS.x; ++light) total += point_light(LIGHT[first + light], n);\n"
+		"	first += LIGHT_COUNTS.x;\n"
+		"	for (uint light = 0u; light < LIGHT_COUNTS.y; ++light) total += hemisphere_light(LIGHT[first + light], n);\n"
+		"	first += LIGHT_COUNTS.y;\n"
+		"	for (uint light = 0u; light < LIGHT_COUNTS.z; ++light) total += spot_light(LIGHT[first + light], n);\n"
+		"	first += LIGHT_COUNTS.z;\n"
+		"	for (uint light = 0u; light < LIGHT_COUNTS.w; ++light) total += directional_light(LIGHT[first + light], n);\n"
+		"#endif\n"
+		"	vec3 reflectance =\n"
+		"		albedo.rgb / 3.1415926; //Lambertian Diffuse\n"
+		"	fragColor = vec4(total * reflectance, albedo.a);\n"
+		"}\n";
+}
+
+LitColorTextureProgram::LitColorTextureProgram() : LitColorTextureProgram(Variant()) {
+}
+
+LitColorTextureProgram::LitColorTextureProgram(Variant const &variant_) : variant(variant_) {
 	//Compile vertex and fragment shaders using the convenient 'gl_compile_program' helper function:
 	program = gl_compile_program(
 		//vertex shader:
@@ -53,10 +234,10 @@ LitColorTextureProgram::LitColorTextureProgram() {
 		"uniform mat4 OBJECT_TO_CLIP;\n"
 		"uniform mat4x3 OBJECT_TO_LIGHT;\n"
 		"uniform mat3 NORMAL_TO_LIGHT;\n"
-		"in vec4 Position;\n"
-		"in vec3 Normal;\n"
-		"in vec4 Color;\n"
-		"in vec2 TexCoord;\n"
+		"layout(location = 0) in vec4 Position;\n"
+		"layout(location = 1) in vec3 Normal;\n"
+		"layout(location = 2) in vec4 Color;\n"
+		"layout(location = 3) in vec2 TexCoord;\n"
 		"out vec3 position;\n"
 		"out vec3 normal;\n"
 		"out vec4 color;\n"
@@ -70,55 +251,9 @@ LitColorTextureProgram::LitColorTextureProgram() {
 		"}\n"
 	,
 		//fragment shader:
-		"#version 330\n"
-		"uniform sampler2D TEX;\n"
-		"uniform uint LIGHTS;\n"
-		"uniform int LIGHT_TYPE[" + std::to_string(MaxLights) + "];\n"
-		"uniform vec3 LIGHT_LOCATION[" + std::to_string(MaxLights) + "];\n"
-		"uniform vec3 LIGHT_DIRECTION[" + std::to_string(MaxLights) + "];\n"
-		"uniform vec3 LIGHT_ENERGY[" + std::to_string(MaxLights) + "];\n"
-		"uniform float LIGHT_CUTOFF[" + std::to_string(MaxLights) + "];\n"
-		"in vec3 position;\n"
-		"in vec3 normal;\n"
-		"in vec4 color;\n"
-		"in vec2 texCoord;\n"
-		"out vec4 fragColor;\n"
-		"void main() {\n"
-		"	vec3 n = normalize(normal);\n"
-		"	vec4 albedo = texture(TEX, texCoord) * color;\n"
-		"	vec3 total = vec3(0.0f); //total light output\n"
-		"	for (uint light = 0u; light < LIGHTS; ++light) {\n"
-		"		int TYPE = LIGHT_TYPE[light];\n"
-		"		vec3 LOCATION = LIGHT_LOCATION[light];\n"
-		"		vec3 DIRECTION = LIGHT_DIRECTION[light];\n"
-		"		vec3 ENERGY = LIGHT_ENERGY[light];\n"
-		"		float CUTOFF = LIGHT_CUTOFF[light];\n"
-		"		vec3 e;\n"
-		"		if (TYPE == 0) { //point light \n"
-		"			vec3 l = (LOCATION - position);\n"
-		"			float dis2 = dot(l,l);\n"
-		"			l = normalize(l);\n"
-		"			float nl = max(0.0, dot(n, l)) / max(1.0, dis2);\n"
-		"			e = nl * ENERGY;\n"
-		"		} else if (TYPE == 1) { //hemi light \n"
-		"			e = (dot(n,-DIRECTION) * 0.5 + 0.5) * ENERGY;\n"
-		"		} else if (TYPE == 2) { //spot light \n"
-		"			vec3 l = (LOCATION - position);\n"
-		"			float dis2 = dot(l,l);\n"
-		"			l = normalize(l);\n"
-		"			float nl = max(0.0, dot(n, l)) / max(1.0, dis2);\n"
-		"			float c = dot(l,-DIRECTION);\n"
-		"			nl *= smoothstep(CUTOFF,mix(CUTOFF,1.0,0.1), c);\n"
-		"			e = nl * ENERGY;\n"
-		"		} else { //(TYPE == 3) //directional light \n"
-		"			e = max(0.0, dot(n,-DIRECTION)) * ENERGY;\n"
-		"		}"
-		"		vec3 reflectance =\n"
-		"			albedo.rgb / 3.1415926; //Lambertian Diffuse\n"
-		"		total += e*reflectance;\n"
-		"	}\n"
-		"	fragColor = vec4(total, albedo.a);\n"
-		"}\n"
+		fragment_shader()
+	,
+		variant.defines()
 	);
 	//As you can see above, adjacent strings in C/C++ are concatenated.
 	// this is very useful for writing long shader programs inline.
@@ -134,14 +269,7 @@ LitColorTextureProgram::LitColorTextureProgram() {
 	OBJECT_TO_LIGHT_mat4x3 = glGetUniformLocation(program, "OBJECT_TO_LIGHT");
 	NORMAL_TO_LIGHT_mat3 = glGetUniformLocation(program, "NORMAL_TO_LIGHT");
 
-	LIGHTS_uint = glGetUniformLocation(program, "LIGHTS");
-
-	LIGHT_TYPE_int = glGetUniformLocation(program, "LIGHT_TYPE");
-	LIGHT_LOCATION_vec3 = glGetUniformLocation(program, "LIGHT_LOCATION");
-	LIGHT_DIRECTION_vec3 = glGetUniformLocation(program, "LIGHT_DIRECTION");
-	LIGHT_ENERGY_vec3 = glGetUniformLocation(program, "LIGHT_ENERGY");
-	LIGHT_CUTOFF_float = glGetUniformLocation(program, "LIGHT_CUTOFF");
-
+	bind_lights_block(program);
 
 	GLuint TEX_sampler2D = glGetUniformLocation(program, "TEX");
 
@@ -154,7 +282,61 @@ LitColorTextureProgram::LitColorTextureProgram() {
 }
 
 LitColorTextureProgram::~LitColorTextureProgram() {
+	if (lights_buffer != 0) {
+		glDeleteBuffers(1, &lights_buffer);
+		lights_buffer = 0;
+	}
+
 	glDeleteProgram(program);
 	program = 0;
 }
 
+void LitColorTextureProgram::bind_lights_block(GLuint program) {
+	GLuint index = glGetUniformBlockIndex(program, "Lights");
+	if (index == GL_INVALID_INDEX) {
+		throw std::runtime_error("Program doesn't have a \"Lights\" uniform block.");
+	}
+	glUniformBlockBinding(program, index, LightsBinding);
+}
+
+void LitColorTextureProgram::set_lights(SlotMap< Scene::Light > const &lights) const {
+	LightBlock block;
+
+	//count the lights of each type (among the first MaxLights), so each type can start right after the one before:
+	Scene::Light const *used[MaxLights];
+	uint32_t used_count = 0;
+	for (Scene::Light const &light : lights) {
+		if (used_count == MaxLights) break;
+		used[used_count++] = &light;
+		block.counts[light_type_index(light.type)] += 1;
+	}
+	uint32_t next[LightBlock::TypeCount];
+	for (uint32_t t = 0, first = 0; t < LightBlock::TypeCount; ++t) {
+		next[t] = first;
+		first += block.counts[t];
+	}
+
+	for (uint32_t i = 0; i < used_count; ++i) {
+		Scene::Light const &light = *used[i];
+		LightBlock::Light &to = block.lights[next[light_type_index(light.type)]++];
+
+		glm::mat4x3 light_to_world = light.transform->make_local_to_world();
+		to.location = light_to_world[3];
+		to.direction = -glm::normalize(light_to_world[2]); //(lights point along their -z axis)
+		to.energy = light.energy;
+		to.cutoff = std::cos(0.5f * light.spot_fov);
+	}
+
+	//(every byte of LightBlock is a field, so comparing bytes compares values)
+	if (lights_uploaded && std::memcmp(&block, &uploaded_lights, sizeof(LightBlock)) == 0) return;
+
+	glBindBuffer(GL_UNIFORM_BUFFER, lights_buffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(LightBlock), &block);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	uploaded_lights = block;
+	lights_uploaded = true;
+
+	GL_ERRORS();
+}
+
@@ -4,11 +4,35 @@
 #include "Load.hpp"
 #include "Scene.hpp"
 
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+
 //Shader program that draws transformed, lit, textured vertices tinted with vertex colors:
 struct LitColorTextureProgram {
-	LitColorTextureProgram();
+	//The same shader source is compiled into variants, chosen by #defines (see gl_compile_program):
+	struct Variant {
+		//when 'fixed', the shader is built for exactly these light counts (light loop unrolled, no branches)
+		// otherwise it loops over whatever counts are in the light block:
+		bool fixed = false;
+		uint8_t point = 0, hemisphere = 0, spot = 0, directional = 0;
+		//when not 'textured', the shader skips the texture lookup (i.e., TEX is treated as white):
+		bool textured = true;
+
+		std::string defines() const;
+		uint32_t key() const; //(unique per variant)
+
+		//fixed variant for the lights set_lights() would upload:
+		static Variant for_lights(SlotMap< Scene::Light > const &lights);
+	};
+
+	LitColorTextureProgram(); //(the base program: Variant())
+	explicit LitColorTextureProgram(Variant const &variant);
 	~LitColorTextureProgram();
 
+	Variant variant;
+
 	GLuint program = 0;
 
 	//Attribute (per-vertex variable) locations:
@@ -17,22 +41,58 @@ struct LitColorTextureProgram {
 	GLuint Color_vec4 = -1U;
 	GLuint TexCoord_vec2 = -1U;
 
+	//(vertex attributes have fixed locations, so one vertex array object works with every variant)
+
 	//Uniform (per-invocation variable) locations:
 	GLuint OBJECT_TO_CLIP_mat4 = -1U;
 	GLuint OBJECT_TO_LIGHT_mat4x3 = -1U;
 	GLuint NORMAL_TO_LIGHT_mat3 = -1U;
 
 	//lighting:
-	GLuint LIGHTS_uint = -1U;
-	
-	GLuint LIGHT_TYPE_int = -1U;
-	GLuint LIGHT_LOCATION_vec3 = -1U;
-	GLuint LIGHT_DIRECTION_vec3 = -1U;
-	GLuint LIGHT_ENERGY_vec3 = -1U;
-	GLuint LIGHT_CUTOFF_float = -1U;
-	
 	enum : uint32_t { MaxLights = 6 };
 
+	//Lights come from the "Lights" uniform block, which every program using fragment_shader() reads
+	// from the same uniform buffer (the base program's lights_buffer, bound to binding point LightsBinding).
+	//The block's contents, in std140 layout:
+	struct LightBlock {
+		//lights are stored grouped by type, in this order:
+		enum : uint32_t { Point = 0, Hemisphere = 1, Spot = 2, Directional = 3, TypeCount = 4 };
+		uint32_t counts[TypeCount] = {0, 0, 0, 0};
+		struct Light {
+			glm::vec3 location = glm::vec3(0.0f);
+			float padding0_ = 0.0f;
+			glm::vec3 direction = glm::vec3(0.0f);
+			float cutoff = 0.0f; //cosine of half the spot cone angle
+			glm::vec3 energy = glm::vec3(0.0f);
+			float padding1_ = 0.0f;
+		} lights[MaxLights];
+	};
+	static_assert(sizeof(LightBlock) == 16 + 48 * MaxLights, "LightBlock matches std140 layout.");
+
+	enum : GLuint { LightsBinding = 0 };
+	GLuint lights_buffer = 0; //(only made by the base program, lit_color_texture_program)
+
+	//bind a program's "Lights" block to lights_buffer:
+	static void bind_lights_block(GLuint program);
+
+	//copy (the first MaxLights of) a scene's lights into lights_buffer:
+	// lights are placed in world space (Scene::draw's default world_to_light) and grouped by type
+	// the buffer is only written (with a single glBufferSubData) when the result differs from the last upload
+	void set_lights(SlotMap< Scene::Light > const &lights) const;
+	mutable LightBlock uploaded_lights;
+	mutable bool lights_uploaded = false;
+
+	//fragment shader source (lighting and texturing), also used by NoteProgram (with the same variant defines):
+	static std::string fragment_shader();
+
+	//compiled variants are cached by Variant::key() and kept until exit (as with Load<>):
+	static LitColorTextureProgram const &get_variant(Variant const &variant);
+
+	//switch a pipeline made from lit_color_texture_program_pipeline to the variant for these lights
+	// (untextured if it still has the default white texture):
+	// call again if the number of lights of each type changes
+	static void specialize(Scene::Drawable::Pipeline *pipeline, SlotMap< Scene::Light > const &lights);
+
 	//Textures:
 	//TEXTURE0 - texture that is accessed by TexCoord
 };
@@ -40,5 +100,5 @@ struct LitColorTextureProgram {
 extern Load< LitColorTextureProgram > lit_color_texture_program;
 
 //For convenient scene-graph setup, copy this object:
-// NOTE: by default, has texture bound to 1-pixel white texture -- so it's okay to use with vertex-color-only meshes.
+// NOTE: by default, its material has texture bound to 1-pixel white texture -- so it's okay to use with vertex-color-only meshes.
 extern Scene::Drawable::Pipeline lit_color_texture_program_pipeline;
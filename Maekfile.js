@@ -43,7 +43,7 @@ if (maek.OS === "windows") {
 		`/wd4611`  //interaction between setjmp and C++ object destruction
 	);
 	maek.options.LINKLibs.push(
-		`/LIBPATH:${NEST_LIBS}/SDL2/lib`, `SDL2main.lib`, `SDL2.lib`, `OpenGL32.lib`, `Shell32.lib`,
+		`/LIBPATH:${NEST_LIBS}/SDL2/lib`, `SDL2main.lib`, `SDL2.lib`, `OpenGL32.lib`, `Shell32.lib`, `Ole32.lib`,
 		`/LIBPATH:${NEST_LIBS}/libpng/lib`, `libpng.lib`,
 		`/LIBPATH:${NEST_LIBS}/zlib/lib`, `zlib.lib`,
 		`/LIBPATH:${NEST_LIBS}/opusfile/lib`, `opusfile.lib`,
@@ -140,6 +140,7 @@ const game_names = [
 	maek.CPP('PlayMode.cpp'),
 	maek.CPP('main.cpp'),
 	maek.CPP('LitColorTextureProgram.cpp'),
+	maek.CPP('NoteProgram.cpp'),
 	//maek.CPP('ColorTextureProgram.cpp'),  //not used right now, but you might want it
 	maek.CPP('Sound.cpp'),
 	maek.CPP('load_wav.cpp'),
@@ -147,13 +148,31 @@ const game_names = [
 	maek.CPP('GP22IntroMode.cpp')
 ];
 
+const beatmap_names = [
+	maek.CPP('Beatmap.cpp'),
+	maek.CPP('NoteStore.cpp'),
+	maek.CPP('ActiveWindow.cpp'),
+	maek.CPP('NoteBounds.cpp'),
+	maek.CPP('LaneIndex.cpp')
+];
+
+const gameplay_names = [
+	maek.CPP('Gameplay.cpp'),
+	maek.CPP('ReplayLog.cpp')
+];
+
+const data_path_names = [
+	maek.CPP('data_path.cpp')
+];
+
 const common_names = [
-	maek.CPP('data_path.cpp'),
+	...data_path_names,
 	maek.CPP('PathFont.cpp'),
 	maek.CPP('PathFont-font.cpp'),
 	maek.CPP('DrawLines.cpp'),
 	maek.CPP('ColorProgram.cpp'),
 	maek.CPP('Scene.cpp'),
+	maek.CPP('SceneHierarchy.cpp'),
 	maek.CPP('Mesh.cpp'),
 	maek.CPP('load_save_png.cpp'),
 	maek.CPP('gl_compile_program.cpp'),
@@ -178,12 +197,30 @@ const show_scene_names = [
 // objFiles: array of objects to link
 // exeFileBase: name of executable file to produce
 //returns exeFile: exeFileBase + a platform-dependant suffix (e.g., '.exe' on windows)
-const game_exe = maek.LINK([...game_names, ...common_names], 'dist/game');
+const game_exe = maek.LINK([...game_names, ...gameplay_names, ...beatmap_names, ...common_names], 'dist/game');
 const show_meshes_exe = maek.LINK([...show_meshes_names, ...common_names], 'scenes/show-meshes');
 const show_scene_exe = maek.LINK([...show_scene_names, ...common_names], 'scenes/show-scene');
+const compile_beatmap_exe = maek.LINK([maek.CPP('compile-beatmap.cpp'), ...beatmap_names], 'scenes/compile-beatmap');
+const bench_beatmap_exe = maek.LINK([maek.CPP('bench-beatmap.cpp'), ...beatmap_names], 'scenes/bench-beatmap');
+//(runs headless, so links no GL / SDL code; lives in dist/ to find beatmaps -- the last replay is read from the user directory, see data_path.hpp)
+const replay_gameplay_exe = maek.LINK([maek.CPP('replay-gameplay.cpp'), ...gameplay_names, ...beatmap_names, ...data_path_names], 'dist/replay-gameplay');
+const bench_gameplay_exe = maek.LINK([maek.CPP('bench-gameplay.cpp'), ...gameplay_names, ...beatmap_names], 'dist/bench-gameplay');
+
+//compile each text chart to the binary '.beatc' format loaded by the game:
+// (every dist/beatmaps/*.txt, so a new chart only needs its entry in PlayMode's song_list)
+const beatmaps = [];
+for (const file of require('fs').readdirSync('dist/beatmaps').filter(file => file.endsWith('.txt')).sort()) {
+	const name = file.slice(0, -'.txt'.length);
+	const txt = `dist/beatmaps/${name}.txt`;
+	const beatc = `dist/beatmaps/${name}.beatc`;
+	maek.RULE([beatc], [compile_beatmap_exe, txt], [
+		[compile_beatmap_exe, txt, beatc]
+	]);
+	beatmaps.push(beatc);
+}
 
 //set the default target to the game (and copy the readme files):
-maek.TARGETS = [game_exe, show_meshes_exe, show_scene_exe, ...copies];
+maek.TARGETS = [game_exe, show_meshes_exe, show_scene_exe, compile_beatmap_exe, bench_beatmap_exe, replay_gameplay_exe, bench_gameplay_exe, ...beatmaps, ...copies];
 
 //the '[targets =] RULE(targets, prerequisites[, recipe])' rule defines a Makefile-style task
 // targets: array of targets the task produces (can include both files and ':abstract targets')
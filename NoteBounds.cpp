@@ -0,0 +1,141 @@
+#include "NoteBounds.hpp"
+
+#include <cassert>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NOTE_BOUNDS_SSE 1
+#include <emmintrin.h>
+#endif
+
+void NoteBounds::clear() {
+	notes.clear();
+	for (auto &v : world_to_local) v.clear();
+	for (auto &v : min) v.clear();
+	for (auto &v : max) v.clear();
+}
+
+void NoteBounds::add(uint32_t note, glm::mat4x3 const &m, glm::vec3 const &min_, glm::vec3 const &max_) {
+	notes.emplace_back(note);
+	for (uint32_t c = 0; c < 4; ++c) {
+		for (uint32_t r = 0; r < 3; ++r) {
+			world_to_local[c * 3 + r].emplace_back(m[c][r]);
+		}
+	}
+	for (uint32_t a = 0; a < 3; ++a) {
+		min[a].emplace_back(min_[a]);
+		max[a].emplace_back(max_[a]);
+	}
+}
+
+/*
+	Slab test of the ray against box i, in the box's local space
+	Reference from https://gamedev.stackexchange.com/questions/18436/most-efficient-aabb-vs-ray-collision-algorithms/18459#18459
+		The local ray direction is not normalized, so 't' is the distance along the world-space ray
+*/
+static bool intersect_one(NoteBounds const &bounds, uint32_t i, glm::vec3 const &pos, glm::vec3 const &dir, float *t) {
+	auto m = [&](uint32_t e) { return bounds.world_to_local[e][i]; };
+	//(terms are summed in the same order as the SSE path, so both give identical results)
+	glm::vec3 local_pos = glm::vec3(
+		(m(0) * pos.x + m(3) * pos.y) + (m(6) * pos.z + m(9)),
+		(m(1) * pos.x + m(4) * pos.y) + (m(7) * pos.z + m(10)),
+		(m(2) * pos.x + m(5) * pos.y) + (m(8) * pos.z + m(11))
+	);
+	glm::vec3 local_dir = glm::vec3(
+		(m(0) * dir.x + m(3) * dir.y) + m(6) * dir.z,
+		(m(1) * dir.x + m(4) * dir.y) + m(7) * dir.z,
+		(m(2) * dir.x + m(5) * dir.y) + m(8) * dir.z
+	);
+
+	//min/max with the same argument order (and so the same NaN behavior) as _mm_min_ps/_mm_max_ps:
+	auto min = [](float a, float b) { return a < b ? a : b; };
+	auto max = [](float a, float b) { return a > b ? a : b; };
+
+	float tmin = -std::numeric_limits< float >::infinity();
+	float tmax = std::numeric_limits< float >::infinity();
+	for (uint32_t a = 0; a < 3; ++a) {
+		float inv = 1.0f / local_dir[a];
+		float t1 = (bounds.min[a][i] - local_pos[a]) * inv;
+		float t2 = (bounds.max[a][i] - local_pos[a]) * inv;
+		tmin = max(tmin, min(t1, t2));
+		tmax = min(tmax, max(t1, t2));
+	}
+
+	// if tmax < 0, ray (line) is intersecting AABB, but the whole AABB is behind us
+	// if tmin > tmax, ray doesn't intersect AABB
+	if (tmax < 0.0f || tmin > tmax) return false;
+
+	*t = tmin;
+	return true;
+}
+
+bool NoteBounds::nearest(glm::vec3 const &pos, glm::vec3 const &dir, uint32_t *note, float *local_t) const {
+	assert(note);
+	assert(local_t);
+
+	uint32_t count = size();
+	uint32_t best = count;
+	float best_t = std::numeric_limits< float >::infinity();
+
+	uint32_t i = 0;
+
+	#ifdef NOTE_BOUNDS_SSE
+	{
+		__m128 const px = _mm_set1_ps(pos.x), py = _mm_set1_ps(pos.y), pz = _mm_set1_ps(pos.z);
+		__m128 const dx = _mm_set1_ps(dir.x), dy = _mm_set1_ps(dir.y), dz = _mm_set1_ps(dir.z);
+		__m128 const zero = _mm_setzero_ps();
+		__m128 const one = _mm_set1_ps(1.0f);
+
+		for (; i + 4 <= count; i += 4) {
+			__m128 m[12];
+			for (uint32_t e = 0; e < 12; ++e) m[e] = _mm_loadu_ps(&world_to_local[e][i]);
+
+			__m128 tmin = _mm_set1_ps(-std::numeric_limits< float >::infinity());
+			__m128 tmax = _mm_set1_ps(std::numeric_limits< float >::infinity());
+			for (uint32_t a = 0; a < 3; ++a) {
+				//row 'a' of the matrix applied to pos (as a point) and dir (as a vector):
+				__m128 lp = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[a], px), _mm_mul_ps(m[3 + a], py)), _mm_add_ps(_mm_mul_ps(m[6 + a], pz), m[9 + a]));
+				__m128 ld = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[a], dx), _mm_mul_ps(m[3 + a], dy)), _mm_mul_ps(m[6 + a], dz));
+				__m128 inv = _mm_div_ps(one, ld);
+				__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&min[a][i]), lp), inv);
+				__m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&max[a][i]), lp), inv);
+				tmin = _mm_max_ps(tmin, _mm_min_ps(t1, t2));
+				tmax = _mm_min_ps(tmax, _mm_max_ps(t1, t2));
+			}
+
+			__m128 hit = _mm_and_ps(_mm_cmpge_ps(tmax, zero), _mm_cmple_ps(tmin, tmax));
+			int mask = _mm_movemask_ps(hit);
+			if (mask == 0) continue;
+
+			alignas(16) float t[4];
+			_mm_store_ps(t, tmin);
+			for (uint32_t lane = 0; lane < 4; ++lane) {
+				if ((mask & (1 << lane)) && t[lane] < best_t) {
+					best = i + lane;
+					best_t = t[lane];
+				}
+			}
+		}
+	}
+	#endif
+
+	for (; i < count; ++i) {
+		float t = 0.0f;
+		if (intersect_one(*this, i, pos, dir, &t) && t < best_t) {
+			best = i;
+			best_t = t;
+		}
+	}
+
+	if (best == count) return false;
+
+	//convert to a local-space distance (as if the local ray direction were normalized):
+	glm::vec3 local_dir = glm::vec3(
+		world_to_local[0][best] * dir.x + world_to_local[3][best] * dir.y + world_to_local[6][best] * dir.z,
+		world_to_local[1][best] * dir.x + world_to_local[4][best] * dir.y + world_to_local[7][best] * dir.z,
+		world_to_local[2][best] * dir.x + world_to_local[5][best] * dir.y + world_to_local[8][best] * dir.z
+	);
+	*note = notes[best];
+	*local_t = best_t * glm::length(local_dir);
+	return true;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+/*
+ * NoteBounds holds the oriented bounding boxes of the notes that can be hit
+ *  this frame, for tracing the crosshair ray against all of them at once.
+ *
+ * Each box is stored as its world-to-local matrix and local min/max corners,
+ *  in structure-of-arrays form, so the ray test runs on four boxes per SSE
+ *  instruction (with a scalar path for the remainder and for other targets).
+ *
+ */
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+struct NoteBounds {
+	void clear();
+
+	//add a box (note is any id the caller wants back from nearest()):
+	void add(uint32_t note, glm::mat4x3 const &world_to_local, glm::vec3 const &min, glm::vec3 const &max);
+
+	uint32_t size() const { return uint32_t(notes.size()); }
+
+	//find the nearest box hit by the ray from pos along (unit-length) dir:
+	// returns false if nothing is hit
+	// local_t is the hit distance measured in the box's local space
+	bool nearest(glm::vec3 const &pos, glm::vec3 const &dir, uint32_t *note, float *local_t) const;
+
+	//----- internals -----
+	std::vector< uint32_t > notes;
+	std::array< std::vector< float >, 12 > world_to_local; //column-major mat4x3 entries
+	std::array< std::vector< float >, 3 > min;
+	std::array< std::vector< float >, 3 > max;
+};
@@ -0,0 +1,149 @@
+#include "NoteProgram.hpp"
+
+#include "LitColorTextureProgram.hpp"
+#include "gl_compile_program.hpp"
+#include "gl_errors.hpp"
+
+#include <cstddef>
+#include <unordered_map>
+
+Load< NoteProgram > note_program(LoadTagEarly);
+
+//local (to this file) cache of compiled variants:
+namespace {
+	std::unordered_map< uint32_t, NoteProgram const * > &variants() {
+		static std::unordered_map< uint32_t, NoteProgram const * > map;
+		return map;
+	}
+}
+
+NoteProgram const &NoteProgram::get_variant(Variant const &variant) {
+	auto f = variants().find(variant.key());
+	if (f != variants().end()) return *f->second;
+	//(the base program is already compiled, no need for another copy)
+	if (variant.key() == Variant().key()) return *note_program;
+
+	NoteProgram const *ret = new NoteProgram(variant);
+	variants().emplace(variant.key(), ret);
+	return *ret;
+}
+
+NoteProgram::NoteProgram() : NoteProgram(Variant()) {
+}
+
+NoteProgram::NoteProgram(Variant const &variant_) : variant(variant_) {
+	//Compile vertex and fragment shaders using the convenient 'gl_compile_program' helper function:
+	program = gl_compile_program(
+		//vertex shader:
+		"#version 330\n"
+		"uniform mat4 WORLD_TO_CLIP;\n"
+		"uniform mat4x3 WORLD_TO_LIGHT;\n"
+		"uniform float TIME;\n"
+		"uniform vec3 VELOCITY;\n"
+		"layout(location = 0) in vec4 Position;\n"
+		"layout(location = 1) in vec3 Normal;\n"
+		"layout(location = 2) in vec4 Color;\n"
+		"layout(location = 3) in vec2 TexCoord;\n"
+		"layout(location = 4) in mat4x3 Placement;\n" //(locations 4-7)
+		"layout(location = 8) in vec3 Timing;\n"
+		"out vec3 position;\n"
+		"out vec3 normal;\n"
+		"out vec4 color;\n"
+		"out vec2 texCoord;\n"
+		"void main() {\n"
+		"	color = Color;\n"
+		"	texCoord = TexCoord;\n"
+		"	if (TIME < Timing.x || TIME >= Timing.z) { //segment hasn't appeared yet or has disappeared, so put every vertex outside the clip volume\n"
+		"		gl_Position = vec4(2.0, 2.0, 2.0, 1.0);\n"
+		"		position = vec3(0.0);\n"
+		"		normal = vec3(0.0, 0.0, 1.0);\n"
+		"		return;\n"
+		"	}\n"
+		"	vec4 world = vec4(Placement * Position + VELOCITY * min(TIME, Timing.y), 1.0);\n"
+		"	gl_Position = WORLD_TO_CLIP * world;\n"
+		"	position = WORLD_TO_LIGHT * world;\n"
+		"	normal = inverse(transpose(mat3(WORLD_TO_LIGHT) * mat3(Placement))) * Normal;\n"
+		"}\n"
+	,
+		//fragment shader:
+		LitColorTextureProgram::fragment_shader()
+	,
+		variant.defines()
+	);
+
+	//look up the locations of vertex attributes:
+	Position_vec4 = glGetAttribLocation(program, "Position");
+	Normal_vec3 = glGetAttribLocation(program, "Normal");
+	Color_vec4 = glGetAttribLocation(program, "Color");
+	TexCoord_vec2 = glGetAttribLocation(program, "TexCoord");
+
+	Placement_mat4x3 = glGetAttribLocation(program, "Placement");
+	Timing_vec3 = glGetAttribLocation(program, "Timing");
+
+	//look up the locations of uniforms:
+	WORLD_TO_CLIP_mat4 = glGetUniformLocation(program, "WORLD_TO_CLIP");
+	WORLD_TO_LIGHT_mat4x3 = glGetUniformLocation(program, "WORLD_TO_LIGHT");
+	TIME_float = glGetUniformLocation(program, "TIME");
+	VELOCITY_vec3 = glGetUniformLocation(program, "VELOCITY");
+
+	LitColorTextureProgram::bind_lights_block(program);
+
+	GLuint TEX_sampler2D = glGetUniformLocation(program, "TEX");
+
+	//set TEX to always refer to texture binding zero:
+	glUseProgram(program);
+	glUniform1i(TEX_sampler2D, 0);
+	glUseProgram(0);
+}
+
+NoteProgram::~NoteProgram() {
+	glDeleteProgram(program);
+	program = 0;
+}
+
+GLuint NoteProgram::make_vao(MeshBuffer const &meshes, GLuint instance_buffer) const {
+	GLuint vao = 0;
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+
+	//per-vertex attributes come from the mesh buffer (as in MeshBuffer::make_vao_for_program):
+	glBindBuffer(GL_ARRAY_BUFFER, meshes.buffer);
+	auto bind_attribute = [&](GLuint location, MeshBuffer::Attrib const &attrib) {
+		if (location == -1U) return;
+		if (attrib.size == 0) {
+			throw std::runtime_error("ERROR: mesh buffer has no data for an attribute of NoteProgram.");
+		}
+		glVertexAttribPointer(location, attrib.size, attrib.type, attrib.normalized, attrib.stride, (GLbyte *)0 + attrib.offset);
+		glEnableVertexAttribArray(location);
+	};
+	bind_attribute(Position_vec4, meshes.Position);
+	bind_attribute(Normal_vec3, meshes.Normal);
+	bind_attribute(Color_vec4, meshes.Color);
+	bind_attribute(TexCoord_vec2, meshes.TexCoord);
+
+	//per-instance attributes advance once per instance:
+	for (GLuint column = 0; column < 4; ++column) {
+		glEnableVertexAttribArray(Placement_mat4x3 + column);
+		glVertexAttribDivisor(Placement_mat4x3 + column, 1);
+	}
+	glEnableVertexAttribArray(Timing_vec3);
+	glVertexAttribDivisor(Timing_vec3, 1);
+	set_first_instance(instance_buffer, 0);
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+
+	GL_ERRORS();
+
+	return vao;
+}
+
+void NoteProgram::set_first_instance(GLuint instance_buffer, GLuint first) const {
+	glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+	GLbyte *base = (GLbyte *)0 + first * sizeof(Instance);
+	for (GLuint column = 0; column < 4; ++column) {
+		glVertexAttribPointer(Placement_mat4x3 + column, 3, GL_FLOAT, GL_FALSE, sizeof(Instance), base + offsetof(Instance, placement) + column * sizeof(glm::vec3));
+	}
+	glVertexAttribPointer(Timing_vec3, 3, GL_FLOAT, GL_FALSE, sizeof(Instance), base + offsetof(Instance, timing));
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "GL.hpp"
+#include "LitColorTextureProgram.hpp"
+#include "Load.hpp"
+#include "Mesh.hpp"
+
+#include <glm/glm.hpp>
+
+//Shader program that draws instances of a note mesh, moving along with the song:
+// each instance is placed where its note is at song time zero and moved by VELOCITY * song time,
+// so the same instance data stays valid all song (see PlayMode::draw_notes)
+// lit and textured the same as LitColorTextureProgram, and compiled into the same variants
+struct NoteProgram {
+	using Variant = LitColorTextureProgram::Variant;
+
+	NoteProgram(); //(the base program: Variant())
+	explicit NoteProgram(Variant const &variant);
+	~NoteProgram();
+
+	Variant variant;
+
+	GLuint program = 0;
+
+	//Attribute (per-vertex variable) locations:
+	GLuint Position_vec4 = -1U;
+	GLuint Normal_vec3 = -1U;
+	GLuint Color_vec4 = -1U;
+	GLuint TexCoord_vec2 = -1U;
+
+	//Per-instance attribute locations:
+	GLuint Placement_mat4x3 = -1U; //(takes four locations, one per column)
+	GLuint Timing_vec3 = -1U;
+
+	//(attributes have fixed locations, so one vertex array object works with every variant)
+
+	//Uniform (per-invocation variable) locations:
+	GLuint WORLD_TO_CLIP_mat4 = -1U;
+	GLuint WORLD_TO_LIGHT_mat4x3 = -1U;
+	GLuint TIME_float = -1U;
+	GLuint VELOCITY_vec3 = -1U;
+
+	//lighting comes from LitColorTextureProgram's light block (see LitColorTextureProgram::set_lights)
+
+	//Textures:
+	//TEXTURE0 - texture that is accessed by TexCoord
+
+	//Per-instance data, as stored in the instance buffer:
+	struct Instance {
+		glm::mat4x3 placement; //object-to-world at song time zero
+		glm::vec3 timing; //song time the segment appears, the song time it stops moving, and the song time it disappears
+	};
+	static_assert(sizeof(Instance) == 4*12 + 4*3, "Instance is packed.");
+
+	//build a vertex array object that reads vertices from 'meshes' and instances from 'instance_buffer':
+	GLuint make_vao(MeshBuffer const &meshes, GLuint instance_buffer) const;
+
+	//point the per-instance attributes of the bound vao at instance 'first' of instance_buffer:
+	// (there's no base instance for glDrawArraysInstanced in OpenGL 3.3)
+	void set_first_instance(GLuint instance_buffer, GLuint first) const;
+
+	//compiled variants are cached by Variant::key() and kept until exit (as with Load<>):
+	static NoteProgram const &get_variant(Variant const &variant);
+};
+
+extern Load< NoteProgram > note_program;
@@ -0,0 +1,72 @@
+#include "NoteStore.hpp"
+
+#include <limits>
+
+void NoteStore::build(Beatmap const &beatmap, float offset) {
+	clear();
+
+	uint32_t count = uint32_t(beatmap.notes.size());
+	hit_begin.reserve(count);
+	hit_end.reserve(count);
+	type.reserve(count);
+	lane.reserve(count);
+	coord_begin.reserve(count);
+	coord_end.reserve(count);
+	skin.reserve(count);
+	segment_begin.reserve(count);
+	segment_end.reserve(count);
+	segment_time_begin.reserve(beatmap.points.size());
+	segment_time_end.reserve(beatmap.points.size());
+
+	for (auto const &note : beatmap.notes) {
+		Beatmap::Point const &first = beatmap.points[note.point_begin];
+		Beatmap::Point const &last = beatmap.points[note.point_end - 1];
+
+		hit_begin.emplace_back(first.time + offset);
+		hit_end.emplace_back(last.time + offset);
+		type.emplace_back(NoteType(note.type));
+		lane.emplace_back(NoteDir(note.dir));
+		coord_begin.emplace_back(first.coord);
+		coord_end.emplace_back(last.coord);
+		skin.emplace_back(note.skin);
+
+		segment_begin.emplace_back(segment_count());
+		if (note.type == NoteType::HOLD) {
+			for (uint32_t i = note.point_begin; i + 1 < note.point_end; ++i) {
+				segment_time_begin.emplace_back(beatmap.points[i].time + offset);
+				segment_time_end.emplace_back(beatmap.points[i+1].time + offset);
+			}
+		} else {
+			segment_time_begin.emplace_back(first.time + offset);
+			segment_time_end.emplace_back(first.time + offset);
+		}
+		segment_end.emplace_back(segment_count());
+	}
+
+	min.assign(count, glm::vec3(0.0f));
+	max.assign(count, glm::vec3(0.0f));
+	reset();
+}
+
+void NoteStore::reset() {
+	state.assign(size(), 0);
+	stop_time.assign(size(), std::numeric_limits< float >::infinity());
+}
+
+void NoteStore::clear() {
+	hit_begin.clear();
+	hit_end.clear();
+	type.clear();
+	lane.clear();
+	coord_begin.clear();
+	coord_end.clear();
+	skin.clear();
+	state.clear();
+	stop_time.clear();
+	min.clear();
+	max.clear();
+	segment_begin.clear();
+	segment_end.clear();
+	segment_time_begin.clear();
+	segment_time_end.clear();
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+/*
+ * A NoteStore holds the notes of one song as parallel arrays (structure-of-arrays),
+ *  so the per-frame passes (update_notes, trace_ray, check_hit) scan dense memory
+ *  instead of chasing per-note heap vectors.
+ *
+ * Notes are indexed in order of their first hit time.
+ * Each note owns a range of segments: single and burst notes have one, hold notes
+ *  have one per pair of consecutive points. Segment i is drawn with note transform i,
+ *  so the segment range of a note is also its range of transform indices.
+ *
+ */
+
+#include "Beatmap.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+struct NoteStore {
+	//state flags:
+	enum : uint8_t {
+		Active = 1, //spawned and moving towards the border
+		BeenHit = 2, //hit (or missed) by the player; won't be scored again
+	};
+
+	//----- per note -----
+	std::vector< float > hit_begin; //first hit time
+	std::vector< float > hit_end; //last hit time (same as hit_begin for single and burst notes)
+	std::vector< NoteType > type;
+	std::vector< NoteDir > lane; //border the note approaches from
+	std::vector< float > coord_begin; //position along the border at hit_begin
+	std::vector< float > coord_end; //position along the border at hit_end
+	std::vector< uint8_t > skin; //mesh index within the active skin
+	std::vector< uint8_t > state; //flags from above
+	std::vector< float > stop_time; //song time the note stopped moving (when a single or burst note is hit; infinity until then)
+	std::vector< glm::vec3 > min; //local-space bounds of the note mesh
+	std::vector< glm::vec3 > max;
+	std::vector< uint32_t > segment_begin; //range of this note's entries in the segment arrays
+	std::vector< uint32_t > segment_end;
+
+	//----- per segment (flattened side table) -----
+	std::vector< float > segment_time_begin;
+	std::vector< float > segment_time_end;
+
+	uint32_t size() const { return uint32_t(hit_begin.size()); }
+	uint32_t segment_count() const { return uint32_t(segment_time_begin.size()); }
+
+	//build from a beatmap, adding 'offset' to every hit time:
+	// (min and max are left at zero -- they depend on the active skin)
+	void build(Beatmap const &beatmap, float offset);
+
+	//clear state flags and timers, so the song can be played again:
+	void reset();
+
+	void clear();
+};
@@ -20,13 +20,11 @@
 #include <iostream>
 #include <fstream>
 #include <string>
-#include <cstring>
 #include <array>
+#include <atomic>
+#include <algorithm>
 #include "glm/gtx/string_cast.hpp"
 
-// float representing a small epsilon
-static float constexpr EPS_F = 0.0000001f;
-
 // initialize the index to look up meshes info
 GLuint main_meshes_for_lit_color_texture_program = 0;
 
@@ -55,6 +53,8 @@ Load< Scene > main_scene(LoadTagDefault, []() -> Scene const * {
 		drawable.pipeline.type = mesh.type;
 		drawable.pipeline.start = mesh.start;
 		drawable.pipeline.count = mesh.count;
+		drawable.min = mesh.min;
+		drawable.max = mesh.max;
 	});
 });
 
@@ -169,78 +169,55 @@ PlayMode::PlayMode() : scene(*main_scene), note_hit_sound(*note_hit), note_miss_
 	std::vector<Drawable> gun_drawables(3);
 
 	for (auto &d : scene.drawables) {
+		Drawable *keep = nullptr; // where to keep this mesh, if it's one the game uses
 		if (d.transform->name.find("NoteHalloween") != std::string::npos) {
 			// store Halloween skin array, only support total 10 skin variations
 			int idx = d.transform->name.at(13) - '0';
-			skin_halloween[idx].type = d.pipeline.type;
-			skin_halloween[idx].start = d.pipeline.start;
-			skin_halloween[idx].count = d.pipeline.count;
+			keep = &skin_halloween[idx];
 		} else if (d.transform->name.find("NoteChristmas") != std::string::npos) {
 			// store Christmas skin array, only support total 10 skin variations
 			int idx = d.transform->name.at(13) - '0';
-			skin_christmas[idx].type = d.pipeline.type;
-			skin_christmas[idx].start = d.pipeline.start;
-			skin_christmas[idx].count = d.pipeline.count;
+			keep = &skin_christmas[idx];
 		} else if (d.transform->name == "Perfect") {
 			// store 3 different "hit" meshes
-			hit_perfect.type = d.pipeline.type;
-			hit_perfect.start = d.pipeline.start;
-			hit_perfect.count = d.pipeline.count;
+			keep = &hit_perfect;
 		} else if (d.transform->name == "Good") {
-			hit_good.type = d.pipeline.type;
-			hit_good.start = d.pipeline.start;
-			hit_good.count = d.pipeline.count;
+			keep = &hit_good;
 		} else if (d.transform->name == "Miss") {
-			hit_miss.type = d.pipeline.type;
-			hit_miss.start = d.pipeline.start;
-			hit_miss.count = d.pipeline.count;
+			keep = &hit_miss;
 		} else if (d.transform->name == "GunSingle") {
 			// store 3 different gun types
-			gun_drawables[0].type = d.pipeline.type;
-			gun_drawables[0].start = d.pipeline.start;
-			gun_drawables[0].count = d.pipeline.count;
+			keep = &gun_drawables[0];
 		} else if (d.transform->name == "GunBurst") {
-			gun_drawables[1].type = d.pipeline.type;
-			gun_drawables[1].start = d.pipeline.start;
-			gun_drawables[1].count = d.pipeline.count;
+			keep = &gun_drawables[1];
 		} else if (d.transform->name == "GunHold") {
-			gun_drawables[2].type = d.pipeline.type;
-			gun_drawables[2].start = d.pipeline.start;
-			gun_drawables[2].count = d.pipeline.count;
+			keep = &gun_drawables[2];
 		} else if (d.transform->name == "Border") {
 			// store health bar relevant meshes
-			border_drawable.type = d.pipeline.type;
-			border_drawable.start = d.pipeline.start;
-			border_drawable.count = d.pipeline.count;
+			keep = &border_drawable;
 		} else if (d.transform->name == "HealthBar") {
-			healthbar_drawable.type = d.pipeline.type;
-			healthbar_drawable.start = d.pipeline.start;
-			healthbar_drawable.count = d.pipeline.count;
+			keep = &healthbar_drawable;
 		} else if (d.transform->name == "HealthBarLeft") {
-			healthbarleft_drawable.type = d.pipeline.type;
-			healthbarleft_drawable.start = d.pipeline.start;
-			healthbarleft_drawable.count = d.pipeline.count;
+			keep = &healthbarleft_drawable;
 		} else if (d.transform->name == "HealthBarRight") {
-			healthbarright_drawable.type = d.pipeline.type;
-			healthbarright_drawable.start = d.pipeline.start;
-			healthbarright_drawable.count = d.pipeline.count;
+			keep = &healthbarright_drawable;
 		} else if (d.transform->name == "Health") {
-			health_drawable.type = d.pipeline.type;
-			health_drawable.start = d.pipeline.start;
-			health_drawable.count = d.pipeline.count;
+			keep = &health_drawable;
 		} else if (d.transform->name == "BGCenter") {
 			// store background wall meshes
-			backgrounds[2].type = d.pipeline.type;
-			backgrounds[2].start = d.pipeline.start;
-			backgrounds[2].count = d.pipeline.count;
+			keep = &backgrounds[2];
 		} else if (d.transform->name == "BGDown") {
-			backgrounds[0].type = d.pipeline.type;
-			backgrounds[0].start = d.pipeline.start;
-			backgrounds[0].count = d.pipeline.count;
+			keep = &backgrounds[0];
 		} else if (d.transform->name == "BGLeft") {
-			backgrounds[1].type = d.pipeline.type;
-			backgrounds[1].start = d.pipeline.start;
-			backgrounds[1].count = d.pipeline.count;
+			keep = &backgrounds[1];
+		}
+
+		if (keep) {
+			keep->type = d.pipeline.type;
+			keep->start = d.pipeline.start;
+			keep->count = d.pipeline.count;
+			keep->min = d.min;
+			keep->max = d.max;
 		}
 	}
 
@@ -251,11 +228,12 @@ PlayMode::PlayMode() : scene(*main_scene), note_hit_sound(*note_hit), note_miss_
 	{ // initialize game state
 		// set up gun meshes
 		gun_transforms.resize(3);
+		gun_scene_drawables.resize(3);
 		for (int i = 0; i < 3; i++) {
 			gun_transforms[i] = new Scene::Transform;
 			gun_transforms[i]->parent = camera->transform;
 			gun_transforms[i]->position = glm::vec3(0.07f, -0.06f, -0.25f);
-			gun_transforms[i]->scale = glm::vec3();
+			gun_transforms[i]->scale = gun_scale;
 
 			scene.drawables.emplace_back(gun_transforms[i]);
 			Scene::Drawable &d_gun = scene.drawables.back();
@@ -264,6 +242,10 @@ PlayMode::PlayMode() : scene(*main_scene), note_hit_sound(*note_hit), note_miss_
 			d_gun.pipeline.type = gun_drawables[i].type;
 			d_gun.pipeline.start = gun_drawables[i].start;
 			d_gun.pipeline.count = gun_drawables[i].count;
+			d_gun.min = gun_drawables[i].min;
+			d_gun.max = gun_drawables[i].max;
+			d_gun.visible = false; // (see show_gun)
+			gun_scene_drawables[i] = &d_gun;
 		}
 
 		// set up health bar meshes
@@ -272,58 +254,76 @@ PlayMode::PlayMode() : scene(*main_scene), note_hit_sound(*note_hit), note_miss_
 			healthbar_transform->name = "Healthbar";
 			healthbar_transform->parent = camera->transform;
 			healthbar_transform->position = healthbar_position;
+			healthbar_transform->scale = healthbar_scale;
 			scene.drawables.emplace_back(healthbar_transform);
 			Scene::Drawable &d1 = scene.drawables.back();
+			healthbar_scene_drawable = &d1;
 			d1.pipeline = lit_color_texture_program_pipeline;
 			d1.pipeline.vao = main_meshes_for_lit_color_texture_program;
 			d1.pipeline.type = healthbar_drawable.type;
 			d1.pipeline.start = healthbar_drawable.start;
 			d1.pipeline.count = healthbar_drawable.count;
+			d1.min = healthbar_drawable.min;
+			d1.max = healthbar_drawable.max;
 
 			healthbarleft_transform = new Scene::Transform;
 			healthbarleft_transform->name = "HealthbarLeft";
 			healthbarleft_transform->parent = healthbar_transform;
+			healthbarleft_transform->scale = healthbar_LR_scale;
 			scene.drawables.emplace_back(healthbarleft_transform);
 			Scene::Drawable &d1l = scene.drawables.back();
+			healthbarleft_scene_drawable = &d1l;
 			d1l.pipeline = lit_color_texture_program_pipeline;
 			d1l.pipeline.vao = main_meshes_for_lit_color_texture_program;
 			d1l.pipeline.type = healthbarleft_drawable.type;
 			d1l.pipeline.start = healthbarleft_drawable.start;
 			d1l.pipeline.count = healthbarleft_drawable.count;
+			d1l.min = healthbarleft_drawable.min;
+			d1l.max = healthbarleft_drawable.max;
 
 			healthbarright_transform = new Scene::Transform;
 			healthbarright_transform->name = "HealthbarRight";
 			healthbarright_transform->parent = healthbar_transform;
+			healthbarright_transform->scale = healthbar_LR_scale;
 			scene.drawables.emplace_back(healthbarright_transform);
 			Scene::Drawable &d1r = scene.drawables.back();
+			healthbarright_scene_drawable = &d1r;
 			d1r.pipeline = lit_color_texture_program_pipeline;
 			d1r.pipeline.vao = main_meshes_for_lit_color_texture_program;
 			d1r.pipeline.type = healthbarright_drawable.type;
 			d1r.pipeline.start = healthbarright_drawable.start;
 			d1r.pipeline.count = healthbarright_drawable.count;
+			d1r.min = healthbarright_drawable.min;
+			d1r.max = healthbarright_drawable.max;
 
 			health_transform = new Scene::Transform;
 			health_transform->name = "Health";
 			health_transform->parent = healthbar_transform;
 			scene.drawables.emplace_back(health_transform);
 			Scene::Drawable &d0 = scene.drawables.back();
+			health_scene_drawable = &d0;
 			d0.pipeline = lit_color_texture_program_pipeline;
 			d0.pipeline.vao = main_meshes_for_lit_color_texture_program;
 			d0.pipeline.type = health_drawable.type;
 			d0.pipeline.start = health_drawable.start;
 			d0.pipeline.count = health_drawable.count;
+			d0.min = health_drawable.min;
+			d0.max = health_drawable.max;
 
 			border_transform = new Scene::Transform;
 			border_transform->name = "Border";
 			border_transform->position = glm::vec3(0.0f, 0.0f, 2.5f);
-			border_transform->scale = glm::vec3(x_scale, y_scale, 0.01f);
+			border_transform->scale = glm::vec3(gameplay.x_scale, gameplay.y_scale, z_scale);
 			scene.drawables.emplace_back(border_transform);
 			Scene::Drawable &d2 = scene.drawables.back();
+			border_scene_drawable = &d2;
 			d2.pipeline = lit_color_texture_program_pipeline;
 			d2.pipeline.vao = main_meshes_for_lit_color_texture_program;
 			d2.pipeline.type = border_drawable.type;
 			d2.pipeline.start = border_drawable.start;
 			d2.pipeline.count = border_drawable.count;
+			d2.min = border_drawable.min;
+			d2.max = border_drawable.max;
 		}
 
 		// set up background walls
@@ -336,47 +336,47 @@ PlayMode::PlayMode() : scene(*main_scene), note_hit_sound(*note_hit), note_miss_
 			bg_transforms[i] = new Scene::Transform;
 			switch (i) {
 				case 0: // Up
-					bg_transforms[i]->position = glm::vec3(0, 5.0f * y_scale, 0);
+					bg_transforms[i]->position = glm::vec3(0, 5.0f * gameplay.y_scale, 0);
 					bg_transforms[i]->rotation = glm::quat(0.0f, 0.0f, 1.0f, 0.0f) * glm::quat(0.0f, 1.0f, 0.0f, 0.0f);
-					bg_transforms[i]->scale = glm::vec3(5.2f * x_scale, 1, bgscale + 0.1f);
+					bg_transforms[i]->scale = glm::vec3(5.2f * gameplay.x_scale, 1, bgscale + 0.1f);
 					tex_ind = *load_tex_wall_up;
 					break;
 				case 1:
-					bg_transforms[i]->position = glm::vec3(0, 5.0f * y_scale, -2.0f * bgscale);
+					bg_transforms[i]->position = glm::vec3(0, 5.0f * gameplay.y_scale, -2.0f * bgscale);
 					bg_transforms[i]->rotation = glm::quat(0.0f, 0.0f, 1.0f, 0.0f) * glm::quat(0.0f, 1.0f, 0.0f, 0.0f);
-					bg_transforms[i]->scale = glm::vec3(5.2f * x_scale, 1, bgscale);
+					bg_transforms[i]->scale = glm::vec3(5.2f * gameplay.x_scale, 1, bgscale);
 					tex_ind = *load_tex_wall_up;
 					break;
 				case 2: // Down
-					bg_transforms[i]->position = glm::vec3(0, -5.0f * y_scale, 0);
-					bg_transforms[i]->scale = glm::vec3(5.2f * x_scale, 1, bgscale + 0.1f);
+					bg_transforms[i]->position = glm::vec3(0, -5.0f * gameplay.y_scale, 0);
+					bg_transforms[i]->scale = glm::vec3(5.2f * gameplay.x_scale, 1, bgscale + 0.1f);
 					tex_ind = *load_tex_wall_down;
 					break;
 				case 3:
-					bg_transforms[i]->position = glm::vec3(0, -5.0f * y_scale, -2.0f * bgscale);
-					bg_transforms[i]->scale = glm::vec3(5.2f * x_scale, 1, bgscale);
+					bg_transforms[i]->position = glm::vec3(0, -5.0f * gameplay.y_scale, -2.0f * bgscale);
+					bg_transforms[i]->scale = glm::vec3(5.2f * gameplay.x_scale, 1, bgscale);
 					tex_ind = *load_tex_wall_down;
 					break;
 				case 4: // Left
-					bg_transforms[i]->position = glm::vec3(-5.0f * x_scale, 0, 0);
-					bg_transforms[i]->scale = glm::vec3(1, 5.2f * y_scale, bgscale + 0.1f);
+					bg_transforms[i]->position = glm::vec3(-5.0f * gameplay.x_scale, 0, 0);
+					bg_transforms[i]->scale = glm::vec3(1, 5.2f * gameplay.y_scale, bgscale + 0.1f);
 					tex_ind = *load_tex_wall_left;
 					break;
 				case 5:
-					bg_transforms[i]->position = glm::vec3(-5.0f * x_scale, 0, -2.0f * bgscale);
-					bg_transforms[i]->scale = glm::vec3(1, 5.2f * y_scale, bgscale);
+					bg_transforms[i]->position = glm::vec3(-5.0f * gameplay.x_scale, 0, -2.0f * bgscale);
+					bg_transforms[i]->scale = glm::vec3(1, 5.2f * gameplay.y_scale, bgscale);
 					tex_ind = *load_tex_wall_left;
 					break;
 				case 6: // Right
-					bg_transforms[i]->position = glm::vec3(5.0f * x_scale, 0, 0);
+					bg_transforms[i]->position = glm::vec3(5.0f * gameplay.x_scale, 0, 0);
 					bg_transforms[i]->rotation = glm::quat(0.0f, 0.0f, 1.0f, 0.0f) * glm::quat(0.0f, 1.0f, 0.0f, 0.0f);
-					bg_transforms[i]->scale = glm::vec3(1, 5.2f * y_scale, bgscale + 0.1f);
+					bg_transforms[i]->scale = glm::vec3(1, 5.2f * gameplay.y_scale, bgscale + 0.1f);
 					tex_ind = *load_tex_wall_right;
 					break;
 				case 7:
-					bg_transforms[i]->position = glm::vec3(5.0f * x_scale, 0, -2.0f * bgscale);
+					bg_transforms[i]->position = glm::vec3(5.0f * gameplay.x_scale, 0, -2.0f * bgscale);
 					bg_transforms[i]->rotation = glm::quat(0.0f, 0.0f, 1.0f, 0.0f) * glm::quat(0.0f, 1.0f, 0.0f, 0.0f);
-					bg_transforms[i]->scale = glm::vec3(1, 5.2f * y_scale, bgscale);
+					bg_transforms[i]->scale = glm::vec3(1, 5.2f * gameplay.y_scale, bgscale);
 					tex_ind = *load_tex_wall_right;
 					break;
 				case 8: // Center front
@@ -386,7 +386,7 @@ PlayMode::PlayMode() : scene(*main_scene), note_hit_sound(*note_hit), note_miss_
 					break;
 				case 9: // Center back
 					bg_transforms[i]->position = glm::vec3(0, 0, bgscale);
-					bg_transforms[i]->scale = glm::vec3(5.0f * x_scale, 5.0f * y_scale, 1);
+					bg_transforms[i]->scale = glm::vec3(5.0f * gameplay.x_scale, 5.0f * gameplay.y_scale, 1);
 					tex_ind = *load_tex_game_over;
 					break;
 			}
@@ -403,8 +403,45 @@ PlayMode::PlayMode() : scene(*main_scene), note_hit_sound(*note_hit), note_miss_
 			d_bg.pipeline.type = backgrounds[ind].type;
 			d_bg.pipeline.start = backgrounds[ind].start;
 			d_bg.pipeline.count = backgrounds[ind].count;
-			d_bg.pipeline.textures[0].texture = tex_ind;
+			d_bg.min = backgrounds[ind].min;
+			d_bg.max = backgrounds[ind].max;
+			Scene::Material material = Scene::material(d_bg.pipeline.material);
+			material.textures[0].texture = tex_ind;
+			d_bg.pipeline.material = Scene::intern_material(material);
+		}
+
+		// set up lights (from the forward lighting class demo): point lights around the camera and a spot light behind it
+		// (they follow the camera's position, but not its rotation -- see draw)
+		scene.lights.clear();
+		auto add_light = [&](glm::vec3 const &offset, Scene::Light::Type type, float energy) {
+			scene.transforms.emplace_back();
+			Scene::Transform &transform = scene.transforms.back();
+			transform.name = "Light";
+			transform.position = camera->transform->position + offset;
+			scene.lights.emplace_back(&transform);
+			Scene::Light &light = scene.lights.back();
+			light.type = type;
+			light.energy = glm::vec3(energy);
+			light.spot_fov = 0.0f; // (the demo's spot cutoff of 1.0)
+			camera_lights.emplace_back(&transform, offset);
+		};
+		add_light(glm::vec3(0.0f, 3.0f, 3.0f), Scene::Light::Point, 50.0f);
+		add_light(glm::vec3(3.0f, 0.0f, -2.0f), Scene::Light::Point, 50.0f);
+		add_light(glm::vec3(-3.0f, 0.0f, -2.0f), Scene::Light::Point, 50.0f);
+		add_light(glm::vec3(0.0f, 3.0f, -2.0f), Scene::Light::Point, 50.0f);
+		add_light(glm::vec3(0.0f, -3.0f, -2.0f), Scene::Light::Point, 50.0f);
+		add_light(glm::vec3(0.0f, 3.0f, 50.0f), Scene::Light::Spot, 10000.0f);
+
+		// the lights are fixed from here on, so draw with shader variants built for exactly these lights
+		for (Scene::Drawable &drawable : scene.drawables) {
+			if (Scene::material(drawable.pipeline.material).program == lit_color_texture_program->program) {
+				LitColorTextureProgram::specialize(&drawable.pipeline, scene.lights);
+			}
 		}
+		// (notes too: they're vertex-colored, so untextured)
+		NoteProgram::Variant note_lights = NoteProgram::Variant::for_lights(scene.lights);
+		note_lights.textured = false;
+		note_variant = &NoteProgram::get_variant(note_lights);
 
 		// load actual audio files and create pairs
 		song_list.emplace_back(std::make_pair("Tutorial", *load_song_tutorial));
@@ -412,6 +449,18 @@ PlayMode::PlayMode() : scene(*main_scene), note_hit_sound(*note_hit), note_miss_
 		song_list.emplace_back(std::make_pair("Hellbound", *load_song_hellbound));
 		song_list.emplace_back(std::make_pair("Halloween Madness", *load_song_halloween_madness));
 
+		// build every song's notes in the background while the intro plays
+		preload_songs();
+
+		// the last song played is recorded here, for replay-gameplay
+		// (in the user directory, since the game's own directory may not be writable)
+		replay_path = user_path("last.replay");
+		replay_saver = std::thread([this]() { run_replay_saver(); });
+
+		// notes are drawn from main_meshes, with per-instance data in note_instance_buffer
+		glGenBuffers(1, &note_instance_buffer);
+		note_instance_vao = note_variant->make_vao(*main_meshes, note_instance_buffer);
+
 		// ready to load main menu
 		to_menu();
 	}
@@ -421,173 +470,171 @@ PlayMode::PlayMode() : scene(*main_scene), note_hit_sound(*note_hit), note_miss_
 	Destructor for PlayMode
 */
 PlayMode::~PlayMode() {
+	for (auto &worker : preload_workers) {
+		worker.join();
+	}
+	if (replay_saver.joinable()) {
+		// (finishes writing a recording it has already been handed)
+		{
+			std::lock_guard<std::mutex> lock(replay_save_mutex);
+			replay_saver_quit = true;
+		}
+		replay_save_cv.notify_all();
+		replay_saver.join();
+	}
+
+	glDeleteVertexArrays(1, &note_instance_vao);
+	note_instance_vao = 0;
+	glDeleteBuffers(1, &note_instance_buffer);
+	note_instance_buffer = 0;
 }
 
 /*
-	Helper function that takes in a string and delimiter and returns a vector of strings formed by splitting by delimiter
-	Reference from https://java2blog.com/split-string-space-cpp/
+	Starts building the notes of every song in song_list on a small pool of worker threads
+		This runs while the intro plays, so starting a song only has to copy the prebuilt notes (see read_notes)
 */
-void tokenize(std::string const &str, const char* delim, std::vector<std::string> &out) {
-
-	char *next_token, *token;
-	#ifdef _WIN32
-    	token = strtok_s(const_cast<char*>(str.c_str()), delim, &next_token);
-	#else
-		token = strtok_r(const_cast<char*>(str.c_str()), delim, &next_token);
-	#endif
-    while (token != nullptr) {
-        out.push_back(std::string(token));
-		#ifdef _WIN32
-			token = strtok_s(nullptr, delim, &next_token);
-		#else
-			token = strtok_r(nullptr, delim, &next_token);
-		#endif
-    }
+void PlayMode::preload_songs() {
+	song_notes.resize(song_list.size());
+
+	// resolve the beatmap paths here, preferring the compiled '.beatc' chart (built from the '.txt' chart by compile-beatmap)
+	std::vector<std::string> paths;
+	for (auto const &song : song_list) {
+		std::string compiled_path = data_path("beatmaps/" + song.first + ".beatc");
+		paths.emplace_back(std::ifstream(compiled_path).good() ? compiled_path : data_path("beatmaps/" + song.first + ".txt"));
+	}
+
+	auto promises = std::make_shared< std::vector< std::promise<void> > >(song_list.size());
+	for (auto &promise : *promises) {
+		song_notes_ready.emplace_back(promise.get_future().share());
+	}
+
+	auto next_song = std::make_shared< std::atomic<size_t> >(0);
+	uint32_t worker_count = std::max(1u, std::min(std::thread::hardware_concurrency(), uint32_t(song_list.size())));
+	for (uint32_t i = 0; i < worker_count; i++) {
+		preload_workers.emplace_back([this, paths, promises, next_song]() {
+			for (size_t idx = (*next_song)++; idx < paths.size(); idx = (*next_song)++) {
+				try {
+					build_song_notes(paths[idx], &song_notes[idx]);
+					(*promises)[idx].set_value();
+				} catch (...) {
+					(*promises)[idx].set_exception(std::current_exception());
+				}
+			}
+		});
+	}
 }
 
 /*
-	Helper function that returns the coordinates on the border given a direction and a value
-		Dir is a string representing a direction
-		Coord should range from -1 to 1, going from left to right and bottom to top.
+Loads a beatmap and builds the notes of a song from it
+	Fills in the NoteStore and the starting placement of every note segment (see Gameplay::place_notes)
+	Only touches song_notes and read-only settings, so it is safe to run on a preload worker
 */
-glm::vec2 PlayMode::get_coords(std::string dir, float coord) {
-	float x = 0.0f;
-	float y = 0.0f;
-	if (dir == "left") {
-		x = -x_scale;
-		y = coord;
-	} else if (dir == "right") {
-		x = x_scale;
-		y = coord;
-	} else if (dir == "up") {
-		x = coord;
-		y = y_scale;
-	} else if (dir == "down") {
-		x = coord;
-		y = -y_scale;
-	} 
-	return glm::vec2(x, y);
+void PlayMode::build_song_notes(std::string const &beatmap_path, SongNotes *song_notes_) const {
+	assert(song_notes_);
+	SongNotes &song = *song_notes_;
+
+	Beatmap beatmap(beatmap_path);
+	song.notes.build(beatmap, gameplay.real_song_offset);
+
+	gameplay.place_notes(beatmap, &song.placements);
+	assert(song.placements.size() == song.notes.segment_count());
 }
 
 /*
-Reads a txt file representing a beatmap and fills in the proper data structures to correctly render on screen
-	Each line of the txt file represents one note (single, burst, hold)
-	In the format of <type> <skin number> <direction> <coord begin> <coord end> @ <time begin> <time end>
-	Constructs a NoteInfo for each line and pushes it into the vector of notes
-		*** Each line must have its time begin and end be less than the time begins of all lines after it ***
+	Fills in the notes of a song from its prebuilt SongNotes and renders them on screen
+		Waits for the preload worker if it hasn't finished with this song yet
+		Picks a random skin and moves every note transform back to its starting placement (invisible), so no beatmap is reparsed
+	Starts gameplay (and its recording) from the beginning of the song
 */
-void PlayMode::read_notes(std::string song_name) {
-	notes.clear();
+void PlayMode::read_notes(int song_idx) {
+	song_notes_ready[song_idx].get(); // rethrows anything the worker threw
+	SongNotes const &song = song_notes[song_idx];
 
 	active_skin_idx = std::rand() % 2;
+	std::vector<Drawable> const &skin = beatmap_skins[active_skin_idx].second;
+	std::array<Mesh const *, 10> skin_meshes;
+	for (uint32_t i = 0; i < skin_meshes.size(); i++) {
+		skin_meshes[i] = &meshBuf->lookup(beatmap_skins[active_skin_idx].first + std::to_string(i));
+	}
 
-	// https://www.tutorialspoint.com/read-file-line-by-line-using-cplusplus
-	std::fstream file;
-	const char* delim = " ";
-	file.open(data_path("beatmaps/" + song_name + ".txt"), std::ios::in);
-	if (file.is_open()){
-		std::string line;
-		int note_idx_read = 0;
-		while(getline(file, line)){
-			std::vector<std::string> note_info;
-			tokenize(line, delim, note_info);
-			std::string note_type = note_info[0];
-			int note_mesh_idx = stoi(note_info[1]);
-			std::string dir = note_info[2];
-			int idx = (int) (find(note_info.begin(), note_info.end(), "@") - note_info.begin());
-
-			NoteInfo note;
-			note.note_idx = note_idx_read;
-			Mesh note_mesh = meshBuf->lookup(beatmap_skins[active_skin_idx].first + note_info[1]);
-			note.min = note_mesh.min;
-			note.max = note_mesh.max;
-			note.dir = dir;
-
-			note.scale = glm::vec3(0.2f, 0.2f, 0.2f);
-
-			if (note_type == "hold") {
-				note.noteType = NoteType::HOLD;
-
-				for (int i = 0; i < idx - 4; i++) {
-					float coord_begin = std::stof(note_info[3+i]);
-					float time_begin = std::stof(note_info[idx+1+i]);
-
-					float coord_end = std::stof(note_info[3+i+1]);
-					float time_end = std::stof(note_info[idx+1+i+1]);
-					note.coord_begin = coord_begin;
-					note.coord_end = coord_end;
-					glm::vec2 coords_begin = get_coords(dir, coord_begin);
-					glm::vec2 coords_end = get_coords(dir, coord_end);
-
-					Scene::Transform *transform = new Scene::Transform;
-					transform->name = "Note";
-					transform->position = glm::vec3((coords_begin.x + coords_end.x) / 2.0f, (coords_begin.y + coords_end.y) / 2.0f, init_note_depth - (time_end - time_begin) * note_speed / 2.0f);
-					transform->scale = glm::vec3(0.0f, 0.0f, 0.0f); // all notes start from being invisible
-					float angle = 0.0f;
-					// if the xs are the same
-					if(dir == "left") {
-						angle = -atan2((coords_begin.y - coords_end.y), (time_end - time_begin) * note_speed);
-						transform->rotation = normalize(glm::angleAxis(angle, glm::vec3(1.0f, 0.0f, 0.0f)) * glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
-					}
-					else if (dir == "right") {
-						angle = -atan2((coords_begin.y - coords_end.y), (time_end - time_begin) * note_speed);
-						transform->rotation = normalize(glm::angleAxis(angle, glm::vec3(1.0f, 0.0f, 0.0f)) * (glm::quat(0.0f, 0.0f, 1.0f, 0.0f) * glm::quat(0.0f, 1.0f, 0.0f, 0.0f)));
-					}
-					else if (dir == "up") {
-						angle = atan2((coords_begin.x - coords_end.x), (time_end - time_begin) * note_speed);
-						transform->rotation = normalize(glm::angleAxis(angle, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::quat(0.7071f, 0.0f, 0.0f, -0.7071f));;
-					}
-					else {
-						angle = atan2((coords_begin.x - coords_end.x), (time_end - time_begin) * note_speed);
-						transform->rotation = normalize(glm::angleAxis(angle, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::quat(0.7071f, 0.0f, 0.0f, 0.7071f));;
-					}
-					note.note_transforms.push_back(transform);
-					note.hit_times.push_back(time_begin + real_song_offset);
-					note.hit_times.push_back(time_end + real_song_offset);
-				}
-			} else {
-				float coord = std::stof(note_info[3]);
-				float time = std::stof(note_info[5]);
-				glm::vec2 coords = get_coords(dir, coord);
-				
-				note.noteType = note_type == "single" ? NoteType::SINGLE : NoteType::BURST;
-
-				Scene::Transform *transform = new Scene::Transform;
-				transform->name = "Note";
-				transform->position = glm::vec3(coords.x, coords.y, init_note_depth);
-				transform->scale = glm::vec3(0.0f, 0.0f, 0.0f); // all notes start from being invisible
-				if(dir == "left") {
-					transform->rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
-				}
-				else if (dir == "right") {
-					transform->rotation = glm::quat(0.0f, 0.0f, 1.0f, 0.0f) * glm::quat(0.0f, 1.0f, 0.0f, 0.0f);
-				}
-				else if (dir == "up") {
-					transform->rotation = glm::quat(0.7071f, 0.0f, 0.0f, -0.7071f);
-				}
-				else {
-					transform->rotation = glm::quat(0.7071f, 0.0f, 0.0f, 0.7071f);
-				}
-				note.note_transforms.push_back(transform);
-				note.hit_times.push_back(time + real_song_offset);
-			}
-
-			notes.push_back(note);
+	gameplay.start(song.notes, song.placements, camera->transform->position, song_list[song_idx].first == "Tutorial");
+	NoteStore &notes = gameplay.notes;
+	for (uint32_t i = 0; i < notes.size(); i++) {
+		notes.min[i] = skin_meshes[notes.skin[i]]->min;
+		notes.max[i] = skin_meshes[notes.skin[i]]->max;
+	}
 
-			for (int i = 0; i < (int)note.note_transforms.size(); i++) {
-				scene.drawables.emplace_back(note.note_transforms[i]);
-				Scene::Drawable &d = scene.drawables.back();
-				d.pipeline = lit_color_texture_program_pipeline;
-				d.pipeline.vao = main_meshes_for_lit_color_texture_program;
-				d.pipeline.type = beatmap_skins[active_skin_idx].second[note_mesh_idx].type;
-				d.pipeline.start = beatmap_skins[active_skin_idx].second[note_mesh_idx].start;
-				d.pipeline.count = beatmap_skins[active_skin_idx].second[note_mesh_idx].count;
-			}
+	// record everything replay-gameplay needs to rebuild the same notes
+	replay.clear();
+	replay.header.step_time = Gameplay::StepTime;
+	replay.header.is_tutorial = gameplay.is_tutorial;
+	for (uint32_t a = 0; a < 3; a++) {
+		replay.header.camera_position[a] = gameplay.camera_position[a];
+	}
+	replay.song = song_list[song_idx].first;
+	for (Mesh const *mesh : skin_meshes) {
+		replay.skin_min.emplace_back(mesh->min);
+		replay.skin_max.emplace_back(mesh->max);
+	}
+	gameplay.recording = &replay;
+	replay_pending = false;
 
-			note_idx_read += 1;
+	// every segment starts with its skin mesh (segment_mesh keeps its storage, so restarting a song allocates nothing)
+	for (uint32_t m = 0; m < HitMissMesh; m++) {
+		note_meshes[m] = skin[m];
+	}
+	note_meshes[HitMissMesh] = hit_miss;
+	note_meshes[HitGoodMesh] = hit_good;
+	note_meshes[HitPerfectMesh] = hit_perfect;
+
+	segment_mesh.resize(notes.segment_count());
+	for (uint32_t i = 0; i < notes.size(); i++) {
+		for (uint32_t s = notes.segment_begin[i]; s < notes.segment_end[i]; s++) {
+			segment_mesh[s] = notes.skin[i];
 		}
-		file.close();
 	}
+
+	notes_time = 0.0f;
+	notes_shown = true;
+	note_instances_dirty = true;
+}
+
+/*
+	Stops drawing notes (until read_notes starts another song)
+*/
+void PlayMode::hide_notes() {
+	notes_shown = false;
+}
+
+/*
+	Helper function that draws a note segment with one of note_meshes
+*/
+void PlayMode::set_note_mesh(uint32_t segment, uint8_t mesh) {
+	segment_mesh[segment] = mesh;
+	note_instances_dirty = true;
+}
+
+/*
+	Helper function that returns the current song position in seconds
+		Read from the audio clock of the playing song (see Sound::PlayingSample::get_time),
+		so notes stay locked to what the player hears and pausing the song pauses the timeline
+*/
+float PlayMode::get_music_time() const {
+	if (!active_song) return 0.0f;
+	return float(active_song->get_time());
+}
+
+/*
+	Helper function that returns the song position (in seconds) at which an SDL event happened
+		SDL stamps each event with SDL_GetTicks() milliseconds when it is queued, so inputs are judged
+		at the time they were made rather than when the frame got around to processing them
+		Events without a timestamp (or stamped in the future) are treated as happening now
+*/
+float PlayMode::event_music_time(uint32_t timestamp) const {
+	float music_time = get_music_time();
+	if (timestamp == 0) return music_time;
+	int32_t age_ms = int32_t(SDL_GetTicks() - timestamp); // (wraps correctly)
+	return music_time - std::max(0, age_ms) / 1000.0f;
 }
 
 /*
@@ -597,433 +644,232 @@ void PlayMode::read_notes(std::string song_name) {
 void PlayMode::update_bg(float elapsed) {
 
 	for (size_t i = 0; i < bg_transforms.size() - 2; i++) {
-		bg_transforms[i]->position.z = bg_transforms[i]->position.z + note_speed * elapsed;
+		bg_transforms[i]->position.z = bg_transforms[i]->position.z + gameplay.note_speed * elapsed;
 		if (bg_transforms[i]->position.z > 2.0f * bgscale) 
 			bg_transforms[i]->position.z = -2.0f * bgscale;
 	}
 
 }
 
-/* 
-	We maintain the list of notes to be checked in the following way: 
-		We keep track of two types of variables. First are note_start_idx and 
-		note_end_idx, which records the range of notes that have spawned but have
-		yet to reach the disappearing line. Second are each note's is_active boolean,
-		which if a note was correctly hit by the player should toggle to false and
-		make the note have 0 scale. We however do not immediately update the indices,
-		meaning the note will continue to move towards the player until it reaches the
-		disappearing line. This is so that we can keep a nice loop from start to end
-		indices without worrying about tight time gaps between notes. 
-
-	Also note that we always loop up to ONE INDEX HIGHER than the end index, to
-	check if we should start the next note or not.
+/*
+	Runs gameplay up to the current song position (see Gameplay::advance) and presents the result
+		Notes are drawn at the song position of the last update (they move on their own in NoteProgram)
 */
-void PlayMode::update_notes(float elapsed) {
+void PlayMode::update_notes() {
 	assert(game_state == PLAYING);
 
-	auto current_time = std::chrono::high_resolution_clock::now();
-	float music_time = std::chrono::duration<float>(current_time - music_start_time).count();
-
-	if (!is_tutorial) {
-		health = std::max(0.0f, health - elapsed / 50.0f);
-		set_health_bar();
-	}
-	if (health < EPS_F) game_over(false);
-
-	for (int i = note_start_idx; i < note_end_idx + 1; i++) {
-		if (i >= (int)notes.size()) continue;
-		auto &note = notes[i];
-		// hold case - multiple note_transforms and hit_times
-		if(note.noteType == NoteType::HOLD) {
-			for (size_t j = 0; j < note.hit_times.size()-1; j++) {
-				if (note.is_active) {
-					if (music_time > note.hit_times[j+1] + valid_hit_time_delta) {
-						// 'delete' the note
-						if (!note.been_hit) hit_note(nullptr, -1);
-
-						note.note_transforms[j]->scale = glm::vec3(0.0f, 0.0f, 0.0f);
-						note_start_idx += 1;
-
-						if (note_start_idx == (int)notes.size()) {
-							song_cleared = true;
-							song_clear_time = std::chrono::high_resolution_clock::now();
-						}
-					}
-					else {
-						// move the note
-						float delta_time = music_time - (note.hit_times[j] - note_approach_time);
-						note.note_transforms[j]->position.z = init_note_depth + note_speed * delta_time;
-					}
-				} else {
-					if (!note.been_hit) {
-						if (music_time >= note.hit_times[j] - note_approach_time) {
-							// spawn the note
-							note.is_active = true;
-							note.note_transforms[j]->scale = glm::vec3(0.5f, 0.5f, note_speed * (note.hit_times[j+1] - note.hit_times[j]) / 4.0f);
-							note.note_transforms[j]->position.z = init_note_depth - (note.hit_times[j+1] - note.hit_times[j]) / 2;
-							note_end_idx += 1;
-						}
-					}
-				}
-			}
-		}
-		// single and burst case - only one note_transform and hit_time
-		else {
-			if (note.is_active) {
-				if (note.been_hit){
-					// after note has been hit, wait a bit before hiding "hit" mesh
-					if (note.delete_time > 0.0f) {
-						note.delete_time -= elapsed;
-					} else {
-						note.note_transforms[0]->scale = glm::vec3(0.0f, 0.0f, 0.0f);
-					}
-				} else {
-					// move the note
-					float delta_time = music_time - (note.hit_times[0] - note_approach_time);
-					note.note_transforms[0]->position.z = init_note_depth + note_speed * delta_time;
-				}
-
-				if (music_time > note.hit_times[0] + valid_hit_time_delta) {
-					// 'delete' the note
-					if (!note.been_hit) hit_note(nullptr, -1);
-
-					note.note_transforms[0]->scale = glm::vec3(0.0f, 0.0f, 0.0f);
-					note_start_idx += 1;
-
-					if (note_start_idx == (int)notes.size()) {
-						song_cleared = true;
-						song_clear_time = std::chrono::high_resolution_clock::now();
-					}
-				}
-			} else {
-				if (!note.been_hit) {
-					if (music_time >= note.hit_times[0] - note_approach_time) {
-						// spawn the note
-						note.is_active = true;
-						note.note_transforms[0]->scale = note.scale;
-						note_end_idx += 1;
-					}
-				}
-			}
-		}
-	}
+	notes_time = get_music_time();
+	gameplay.advance(notes_time);
+	present_gameplay();
 }
 
 /*
-	Helper function to run AABB intersection
-	Reference from https://gamedev.stackexchange.com/questions/18436/most-efficient-aabb-vs-ray-collision-algorithms/18459#18459
+	Reacts to everything gameplay reported since the last call
+		Called after every update and every input while PLAYING
 */
-bool PlayMode::bbox_intersect(glm::vec3 pos, glm::vec3 dir, glm::vec3 min, glm::vec3 max, float &t) 
-{ 
-	// r.dir is unit direction vector of ray
-	glm::vec3 dirfrac;
-	dirfrac.x = 1.0f / dir.x;
-	dirfrac.y = 1.0f / dir.y;
-	dirfrac.z = 1.0f / dir.z;
-	// min is the corner of AABB with minimal coordinates - left bottom, ma is maximal corner
-	// pos is origin of ray
-	float t1 = (min.x - pos.x)*dirfrac.x;
-	float t2 = (max.x - pos.x)*dirfrac.x;
-	float t3 = (min.y - pos.y)*dirfrac.y;
-	float t4 = (max.y - pos.y)*dirfrac.y;
-	float t5 = (min.z - pos.z)*dirfrac.z;
-	float t6 = (max.z - pos.z)*dirfrac.z;
-
-	float tmin = std::max(std::max(std::min(t1, t2), std::min(t3, t4)), std::min(t5, t6));
-	float tmax = std::min(std::min(std::max(t1, t2), std::max(t3, t4)), std::max(t5, t6));
-
-	// if tmax < 0, ray (line) is intersecting AABB, but the whole AABB is behind us
-	if (tmax < 0)
-	{
-		t = tmax;
-		return false;
+void PlayMode::present_gameplay() {
+	for (auto const &event : gameplay.events) {
+		if (event.type == Gameplay::Event::Judge) {
+			show_judgement(event.note, event.status);
+		} else {
+			// spawned or retired, so the live notes to draw changed
+			note_instances_dirty = true;
+		}
 	}
+	gameplay.events.clear();
 
-	// if tstd::min > tmax, ray doesn't intersect AABB
-	if (tmin > tmax)
-	{
-		t = tmax;
-		return false;
-	}
-	
-	t = tmin;
-	return true;
-}
+	set_health_bar();
 
-/*
-	Helper function to trace a ray from pos in dir direction against every visible note
-		Transforms both pos and dir to note's local space in order to take care of OBB
-*/
-// currently using the same code three times, maybe think about what would actually be different between the three?
-HitInfo PlayMode::trace_ray(glm::vec3 pos, glm::vec3 dir) {
-	for (int i = note_start_idx; i < note_end_idx; i++) {
-		NoteInfo &note = notes[i];
-
-		if (note.note_transforms[0]->scale == glm::vec3()) continue;
-
-		// single type
-		if (note.noteType == NoteType::SINGLE) {
-			if (note.been_hit) continue;
-			// get transform
-			Scene::Transform *trans = note.note_transforms[0];
-			// transform ray https://stackoverflow.com/questions/44630118/ray-transformation-in-a-ray-obb-intersection-test
-			glm::mat4 inverse = trans->make_world_to_local();
-			glm::vec4 start = inverse * glm::vec4(pos, 1.0);
-			glm::vec4 direction = inverse * glm::vec4(dir, 0.0);
-			direction = glm::normalize(direction);
-			float t = 0.0f;
-			// do bbox intersection
-			if(bbox_intersect(start, direction, note.min, note.max, t)) {
-				HitInfo hits;
-				hits.note = &notes[i];
-				hits.time = t;
-				return hits;
-			}
-		}
-		// burst type
-		else if(note.noteType == NoteType::BURST) {
-			if (note.been_hit) continue;
-			// get transform
-			Scene::Transform *trans = note.note_transforms[0];
-			// transform ray https://stackoverflow.com/questions/44630118/ray-transformation-in-a-ray-obb-intersection-test
-			glm::mat4 inverse = trans->make_world_to_local();
-			glm::vec4 start = inverse * glm::vec4(pos, 1.0);
-			glm::vec4 direction = inverse * glm::vec4(dir, 0.0);
-			direction = glm::normalize(direction);
-			// transform bounding box of note to world space
-			float t = 0.0f;
-			// do bbox intersection
-			if(bbox_intersect(start, direction, note.min, note.max, t)) {
-				HitInfo hits;
-				hits.note = &notes[i];
-				hits.time = t;
-				return hits;
-			}
-		}
-		// hold type
-		else if(note.noteType == NoteType::HOLD) {
-
-			// assume we only have one hold per hold note
-
-			Scene::Transform *trans = note.note_transforms[0];
-			// transform ray https://stackoverflow.com/questions/44630118/ray-transformation-in-a-ray-obb-intersection-test
-			glm::mat4 inverse = trans->make_world_to_local();
-			glm::vec4 start = inverse * glm::vec4(pos, 1.0);
-			glm::vec4 direction = inverse * glm::vec4(dir, 0.0);
-			direction = glm::normalize(direction);
-			// transform bounding box of note to world space
-			float t = 0.0f;
-			// do bbox intersection
-			if(bbox_intersect(start, direction, note.min, note.max, t)) {
-				// initial click (whether it's the start or not)
-				HitInfo hits;
-				hits.note = &notes[i];
-				hits.time = t;
-				return hits;
-			}
-		}
-		else {
-			// incorrect note type breaks the game
-			exit(1);
-		}
+	if (gameplay.failed) {
+		game_over(false);
+		return;
+	}
+	if (gameplay.cleared && !song_cleared) {
+		song_cleared = true;
+		song_clear_time = std::chrono::high_resolution_clock::now();
 	}
-
-	return HitInfo();
 }
 
-void PlayMode::set_combo(int diff) {
-	combo += diff;
-	multiplier = combo / 25 + 1;
-	if (combo > max_combo) max_combo = combo;
-}
 
 /*
-	Update function to a note, score / combo and health
+	Plays the sound and shows the "hit" mesh for a note gameplay judged
+		note_idx is -1 for a note that retired without being hit
 */
-void PlayMode::hit_note(NoteInfo* note, int hit_status) {
-
+void PlayMode::show_judgement(int note_idx, int hit_status) {
 	if (hit_status == -1) {
 		Sound::play(note_miss_sound);
-		set_combo(-combo);
-		if (is_tutorial) return;
-		health = std::max(0.0f, health - 0.1f);
-		set_health_bar();
-		if (health < EPS_F) game_over(false);
 		return;
 	}
 
-	auto curr_note = std::prev(scene.drawables.end(), notes.size());
-	curr_note = std::next(curr_note, note->note_idx);
-
-	// deactivate the note
-	note->been_hit = true;
+	// the "hit" mesh replaces the note's first segment (a hold's head)
+	uint32_t segment = gameplay.notes.segment_begin[note_idx];
 
 	switch (hit_status) {
-		case 0:
-			// bad hit, same as miss
+		case 0: // bad hit, same as miss
+		case 3: // wrong gun hit
 			Sound::play(note_miss_sound);
-
-			curr_note->pipeline.type = hit_miss.type;
-			curr_note->pipeline.start = hit_miss.start;
-			curr_note->pipeline.count = hit_miss.count;
-
-			set_combo(-combo);
-			if (!is_tutorial) {
-				health = std::max(0.0f, health - 0.1f);
-				if (health < EPS_F) game_over(false);
-			}
+			set_note_mesh(segment, HitMissMesh);
 			break;
 		case 1:
 			// good hit
 			Sound::play(note_hit_sound);
-
-			curr_note->pipeline.type = hit_good.type;
-			curr_note->pipeline.start = hit_good.start;
-			curr_note->pipeline.count = hit_good.count;
-
-			score += 50 * multiplier;
-			set_combo(1);
-			health = std::min(max_health, health + 0.03f);
+			set_note_mesh(segment, HitGoodMesh);
 			break;
 		case 2:
 			// perfect hit
 			Sound::play(note_hit_sound);
-
-			curr_note->pipeline.type = hit_perfect.type;
-			curr_note->pipeline.start = hit_perfect.start;
-			curr_note->pipeline.count = hit_perfect.count;
-
-			score += 100 * multiplier;
-			set_combo(1);
-			health = std::min(max_health, health + 0.03f);
-			break;
-		case 3:
-			// wrong gun hit
-			Sound::play(note_miss_sound);
-
-			curr_note->pipeline.type = hit_miss.type;
-			curr_note->pipeline.start = hit_miss.start;
-			curr_note->pipeline.count = hit_miss.count;
-
-			score += 10 * multiplier;
-			set_combo(-combo);
+			set_note_mesh(segment, HitPerfectMesh);
 			break;
 		case 4:
 			// hold begin and end
 			Sound::play(note_hit_sound);
-			score += 10 * multiplier;
-			set_combo(1);
-			health = std::min(max_health, health + 0.03f);
-			break;
-		case 5:
-			// hold during success
-			score += 1 * multiplier;
-			set_combo(1);
-			health = std::min(max_health, health + 0.0003f);
-			break;
-		case 6:
-			// hold during fail
-			set_combo(-combo);
-			if (is_tutorial) {
-				health = std::max(0.0f, health - 0.0003f);
-			}
 			break;
 	}
+}
 
-	set_health_bar();
+/*
+	Helper function to show the gun of the current firing mode
+*/
+void PlayMode::show_gun() {
+	for (int i = 0; i < 3; i++) {
+		gun_scene_drawables[i]->visible = (i == gameplay.gun_mode);
+	}
 }
 
 /*
-	Function called whenever we click on the screen
-		Checks if we hit any note, see if the hit is valid or not and then calls hit note based on that
+	Gathers an instance for every segment of every live note, grouped by mesh, and uploads them
+		Each instance is placed where gameplay puts its segment at song time zero; NoteProgram moves it from there
+		Each segment of a hold appears note_approach_time before its own begin time, as it would spawn on its own
+		The instance buffer only grows, so restarting a song doesn't reallocate it
 */
-void PlayMode::check_hit(bool mouse_down=true) {
-	// ray from camera position to origin (p1 - p2)
-	glm::vec3 ray = glm::vec3(0) - camera->transform->position;
-	// rotate ray to get the direction from camera
-	ray = glm::normalize(glm::rotate(camera->transform->rotation, ray));
-	// trace the ray to see if we hit a note
-	HitInfo hits = trace_ray(camera->transform->position, ray);
-
-	auto current_time = std::chrono::high_resolution_clock::now();
-	float music_time = std::chrono::duration<float>(current_time - music_start_time).count();
-	// if we hit a note, check to see if we hit a good time
-	if(hits.note) {
-		if(hits.note->noteType == NoteType::HOLD) {
-			// only considers first 0.2 seconds of the hold -> need to change
-			if(fabs(music_time - hits.note->hit_times[0]) < valid_hit_time_delta && !holding && mouse_down) {
-				// initial click
-				hit_note(hits.note, 4);
-			}
-			else if(fabs(hits.note->hit_times[1] - music_time) < valid_hit_time_delta && !holding && !mouse_down) {
-				// release near the end
-				hit_note(hits.note, 4);
-			}
-			else if (holding) {
-				// holding in between note
-				// want to do linear interpolation between the hit_times depending on how fast the note is approaching
-				glm::vec2 coord = get_coords(hits.note->dir, hits.note->coord_begin + (music_time - hits.note->hit_times[0] + real_song_offset) * (hits.note->coord_end - hits.note->coord_begin) / (hits.note->hit_times[1] - hits.note->hit_times[0]));
-				
-				glm::mat4 inverse = hits.note->note_transforms[0]->make_world_to_local();
-				glm::vec3 start = glm::vec3(inverse * glm::vec4(camera->transform->position, 1.0f));
-				glm::vec3 end = glm::vec3(inverse * glm::vec4(coord.x, coord.y, border_depth, 1.0f));
-				float dist = glm::distance(start, end);
-				end = glm::vec3(inverse * glm::vec4(coord.x, coord.y, 2.5f, 1.0f));
-				if(gun_mode == 2 && dist - 0.5 < hits.time && hits.time < dist + 0.5) {
-					hit_note(hits.note, 5);	
-				}
-				else {	
-					hit_note(hits.note, 6);
-				}
-			}
+void PlayMode::build_note_instances() {
+	NoteStore const &notes = gameplay.notes;
+	ActiveWindow const &window = gameplay.note_window;
+
+	// count the instances of each mesh, then lay the meshes out one after another
+	std::array<uint32_t, NoteMeshCount> cursor = {};
+	for (uint32_t k = 0; k < window.live_count(); k++) {
+		uint32_t i = window.live_note(k);
+		if (window.is_retired(i)) continue;
+		for (uint32_t s = notes.segment_begin[i]; s < notes.segment_end[i]; s++) {
+			cursor[segment_mesh[s]] += 1;
 		}
-		else {
-			if (holding || !mouse_down) return; // don't allow mouse LMB down hold cheese or lifting mouse button up
-
-			// valid hit time for single and burst
-			if(fabs(music_time - hits.note->hit_times[0]) < valid_hit_time_delta / 2.0f) {
-				// good hit
-				if ((gun_mode == 0 && hits.note->noteType == NoteType::SINGLE) || (gun_mode == 1 && hits.note->noteType == NoteType::BURST)){
-					hit_note(hits.note, 2);
-				} else {
-					hit_note(hits.note, 3);
-				}
-			} else if (fabs(music_time - hits.note->hit_times[0]) < valid_hit_time_delta) {
-				// ok hit
-				if ((gun_mode == 0 && hits.note->noteType == NoteType::SINGLE) || (gun_mode == 1 && hits.note->noteType == NoteType::BURST)){
-					hit_note(hits.note, 1);
-				} else {
-					hit_note(hits.note, 3);
-				}
-			}
-			else {
-				// bad hit
-				hit_note(hits.note, 0);
-			}
+	}
+	note_instance_offsets[0] = 0;
+	for (uint32_t m = 0; m < NoteMeshCount; m++) {
+		note_instance_offsets[m + 1] = note_instance_offsets[m] + cursor[m];
+		cursor[m] = note_instance_offsets[m];
+	}
+	note_instances.resize(note_instance_offsets[NoteMeshCount]);
+
+	for (uint32_t k = 0; k < window.live_count(); k++) {
+		uint32_t i = window.live_note(k);
+		if (window.is_retired(i)) continue;
+
+		// (notes that never stop get a time far past the end of any song)
+		float stop_time = std::min(notes.stop_time[i], std::numeric_limits<float>::max());
+		float hide_time = stop_time + gameplay.hit_show_time;
+
+		for (uint32_t s = notes.segment_begin[i]; s < notes.segment_end[i]; s++) {
+			glm::mat3 rotation = glm::mat3_cast(gameplay.segment_rotation[s]);
+			glm::vec3 scale = gameplay.segment_scale[s];
+			NoteProgram::Instance &instance = note_instances[cursor[segment_mesh[s]]++];
+			instance.placement = glm::mat4x3(
+				rotation[0] * scale.x,
+				rotation[1] * scale.y,
+				rotation[2] * scale.z,
+				gameplay.segment_position_at(i, s, 0.0f)
+			);
+			instance.timing = glm::vec3(notes.segment_time_begin[s] - gameplay.note_approach_time, stop_time, hide_time);
 		}
 	}
-	else {
-		// miss
+
+	GLsizeiptr bytes = note_instances.size() * sizeof(NoteProgram::Instance);
+	glBindBuffer(GL_ARRAY_BUFFER, note_instance_buffer);
+	if (bytes > note_instance_capacity) {
+		note_instance_capacity = std::max(bytes, 2 * note_instance_capacity);
+		glBufferData(GL_ARRAY_BUFFER, note_instance_capacity, nullptr, GL_DYNAMIC_DRAW);
+	}
+	glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, note_instances.data());
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	note_instances_dirty = false;
+}
+
+/*
+	Draws the notes with one glDrawArraysInstanced per mesh (after the scene, as their drawables used to be)
+*/
+void PlayMode::draw_notes(glm::mat4 const &world_to_clip) {
+	if (!notes_shown) return;
+	if (note_instances_dirty) build_note_instances();
+	if (note_instances.empty()) return;
+
+	glUseProgram(note_variant->program);
+	glUniformMatrix4fv(note_variant->WORLD_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(world_to_clip));
+	glm::mat4x3 world_to_light = glm::mat4x3(1.0f);
+	glUniformMatrix4x3fv(note_variant->WORLD_TO_LIGHT_mat4x3, 1, GL_FALSE, glm::value_ptr(world_to_light));
+	glUniform1f(note_variant->TIME_float, notes_time);
+	glUniform3f(note_variant->VELOCITY_vec3, 0.0f, 0.0f, gameplay.note_speed);
+
+	// (the untextured variant doesn't read a texture, so none is bound)
+
+	glBindVertexArray(note_instance_vao);
+	for (uint32_t m = 0; m < NoteMeshCount; m++) {
+		uint32_t first = note_instance_offsets[m];
+		uint32_t count = note_instance_offsets[m + 1] - first;
+		if (count == 0 || note_meshes[m].count == 0) continue;
+		note_variant->set_first_instance(note_instance_buffer, first);
+		glDrawArraysInstanced(note_meshes[m].type, note_meshes[m].start, note_meshes[m].count, count);
 	}
+	glBindVertexArray(0);
+
+	glUseProgram(0);
+
+	GL_ERRORS();
 }
 
 /*
-	Helper function to change gun firing mode and relevant drawable / transform settings
+	Hands the recording of the song in progress (ending with a final checkpoint) to replay_saver
+		Called whenever a song ends: cleared, failed, restarted or exited
+		The recording is swapped into replay_to_save rather than copied, and read_notes clears whatever
+		storage it gets back, so saving adds no allocation or file access to restarting a song
+		(only if the previous recording is somehow still being written does this wait for it)
 */
-void PlayMode::change_gun(int idx_change, int manual_idx=-1) {
-	assert(manual_idx != -1 || (idx_change == 1 || idx_change == -1));
+void PlayMode::save_replay() {
+	if (!replay_pending) return;
+	replay_pending = false;
 
-	if (manual_idx != -1) {
-		gun_mode = manual_idx;
-		gun_transforms[manual_idx]->scale = gun_scale;
-	} else {
-		gun_transforms[gun_mode]->scale = glm::vec3();
+	gameplay.checkpoint();
+	gameplay.recording = nullptr;
+	{
+		std::unique_lock<std::mutex> lock(replay_save_mutex);
+		replay_save_cv.wait(lock, [this]() { return !replay_save_queued; });
+		std::swap(replay, replay_to_save);
+		replay_save_queued = true;
+	}
+	replay_save_cv.notify_all();
+}
 
-		gun_mode += idx_change;
-		if (gun_mode == 3) gun_mode = 0;
-		else if (gun_mode == -1) gun_mode = 2;
+/*
+	Writes each recording save_replay hands over to replay_path, until the destructor asks it to quit
+		A failed write only costs the replay, so it is reported rather than thrown
+*/
+void PlayMode::run_replay_saver() {
+	std::unique_lock<std::mutex> lock(replay_save_mutex);
+	while (true) {
+		replay_save_cv.wait(lock, [this]() { return replay_save_queued || replay_saver_quit; });
+		if (!replay_save_queued) break;
+
+		lock.unlock();
+		try {
+			replay_to_save.save(replay_path);
+		} catch (std::exception &e) {
+			std::cerr << "Failed to save replay: " << e.what() << std::endl;
+		}
+		lock.lock();
 
-		gun_transforms[gun_mode]->scale = gun_scale;
+		replay_save_queued = false;
+		replay_save_cv.notify_all();
 	}
 }
 
@@ -1033,8 +879,7 @@ void PlayMode::change_gun(int idx_change, int manual_idx=-1) {
 void PlayMode::reset_song() {
 	// reset loaded assets
 	if (active_song) active_song->stop();
-	scene.drawables.erase(std::prev(scene.drawables.end(), notes.size()), scene.drawables.end());
-	read_notes(song_list[chosen_song].first);
+	read_notes(chosen_song);
 }
 
 /*
@@ -1043,6 +888,8 @@ void PlayMode::reset_song() {
 
 */
 void PlayMode::to_menu() {
+	save_replay();
+
 	// reset all state variables
 	has_started = false;
 	game_state = MENU;
@@ -1052,18 +899,16 @@ void PlayMode::to_menu() {
 	bg_transforms[9]->position = glm::vec3(0.0f, 0.0f, bgscale);
 
 	for (int i = 0; i < 3; i++) {
-		gun_transforms[i]->scale = glm::vec3();
+		gun_scene_drawables[i]->visible = false;
 	}
 
-	healthbar_transform->scale = glm::vec3();
-	healthbarleft_transform->scale = glm::vec3();
-	healthbarright_transform->scale = glm::vec3();
-	border_transform->scale = glm::vec3();
+	healthbar_scene_drawable->visible = false;
+	healthbarleft_scene_drawable->visible = false;
+	healthbarright_scene_drawable->visible = false;
+	health_scene_drawable->visible = false;
+	border_scene_drawable->visible = false;
 
-	if (notes.size() >= 1) {
-		reset_song();
-		scene.drawables.erase(std::prev(scene.drawables.end(), notes.size()), scene.drawables.end());
-	}
+	hide_notes();
 	reset_cam();
 
 	// stop currently playing song
@@ -1074,18 +919,21 @@ void PlayMode::to_menu() {
 }
 
 void PlayMode::set_health_bar() {
+	float health = gameplay.health;
 	if (health >= health_right_cutoff) {
 		health_transform->scale.x = 1.0f;
-		healthbarleft_transform->scale = glm::vec3(1.0f, 1.0f, 1.0f);
-		healthbarright_transform->scale = glm::vec3(1.0f, 1.0f, 1.0f);
+		health_scene_drawable->visible = true;
+		healthbarleft_scene_drawable->visible = true;
+		healthbarright_scene_drawable->visible = true;
 	} else if (health >= health_left_cutoff) {
 		health_transform->scale.x = (health - health_left_cutoff) / (health_right_cutoff - health_left_cutoff);
-		healthbarleft_transform->scale = glm::vec3(1.0f, 1.0f, 1.0f);
-		healthbarright_transform->scale = glm::vec3(0.0f, 0.0f, 0.0f);
+		health_scene_drawable->visible = true;
+		healthbarleft_scene_drawable->visible = true;
+		healthbarright_scene_drawable->visible = false;
 	} else {
-		health_transform->scale.x = 0.0f;
-		healthbarleft_transform->scale = glm::vec3(0.0f, 0.0f, 0.0f);
-		healthbarright_transform->scale = glm::vec3(0.0f, 0.0f, 0.0f);
+		health_scene_drawable->visible = false;
+		healthbarleft_scene_drawable->visible = false;
+		healthbarright_scene_drawable->visible = false;
 	}
 }
 
@@ -1099,47 +947,25 @@ void PlayMode::start_song(int idx, bool restart) {
 	if (bg_loop) bg_loop->stop();
 
 	song_cleared = false;
-	holding = false;
 
 	reset_cam();
 	SDL_SetRelativeMouseMode(SDL_TRUE);
 
-	note_start_idx = 0;
-	note_end_idx = 0;
-	score = 0;
-	combo = 0;
-	max_combo = 0;
-	multiplier = 1;
-	health = 0.7f;
-
-	for (int i = 0; i < 3; i++) {
-		gun_transforms[i]->scale = glm::vec3();
-	}
-
-	healthbar_transform->scale = healthbar_scale;
-	healthbarleft_transform->scale = healthbar_LR_scale;
-	healthbarright_transform->scale = healthbar_LR_scale;
-	border_transform->scale = glm::vec3(x_scale, y_scale, z_scale);
-
-	set_health_bar();
-
-	change_gun(0, 0);
+	healthbar_scene_drawable->visible = true;
+	border_scene_drawable->visible = true;
 
 	has_started = true;
 	game_state = PLAYING;
 	chosen_song = idx;
 
-	is_tutorial = false;
-	if (song_list[chosen_song].first == "Tutorial") {
-		is_tutorial = true;
-	}
-
-	music_start_time = std::chrono::high_resolution_clock::now();
-
-	// choose the song based on index
+	// choose the song based on index (this also resets gameplay)
 	if (!restart) {
-		read_notes(song_list[idx].first);
+		read_notes(idx);
 	}
+	set_health_bar();
+	show_gun();
+
+	replay_pending = true;
 	active_song = Sound::play(song_list[idx].second);
 }
 
@@ -1148,6 +974,7 @@ void PlayMode::start_song(int idx, bool restart) {
 		restart_song should only be called when going from PLAYING -> PAUSED -> select RESTART
 */
 void PlayMode::restart_song() {
+	save_replay();
 	bg_transforms[8]->position = glm::vec3(0.0f, 0.0f, -bgscale);
 	bg_transforms[9]->position = glm::vec3(0.0f, 0.0f, bgscale);
 	reset_song();
@@ -1162,7 +989,6 @@ void PlayMode::restart_song() {
 void PlayMode::pause_song() {
 	game_state = PAUSED;
 	hovering_text = 0;
-	music_pause_time = std::chrono::high_resolution_clock::now();
 	active_song->pause(true);
 }
 
@@ -1173,25 +999,24 @@ void PlayMode::pause_song() {
 void PlayMode::unpause_song() {
 	game_state = PLAYING;
 	SDL_SetRelativeMouseMode(SDL_TRUE);
-	// TO CONSIDER : std::chrono's time may run slightly differently from SDL's audio timestamp. might want to compensate for this
-	auto current_time = std::chrono::high_resolution_clock::now();
-	music_start_time += current_time - music_pause_time;
 	active_song->pause(false);
 }
 
 /*
 	Function that ends the game and makes all events do nothing
-		Should be called when either health reaches zero or if note_start_idx is equal to the end of the vector 
+		Should be called when either health reaches zero or if every note has been retired 
 */
 void PlayMode::game_over(bool did_clear) {
+	save_replay();
 	reset_cam();
 	if (active_song) active_song->set_volume(0.0f, 3.0f);
 
-	healthbar_transform->scale = glm::vec3();
-	healthbarleft_transform->scale = glm::vec3();
-	healthbarright_transform->scale = glm::vec3();
-	border_transform->scale = glm::vec3();
-	gun_transforms[gun_mode]->scale = glm::vec3();
+	healthbar_scene_drawable->visible = false;
+	healthbarleft_scene_drawable->visible = false;
+	healthbarright_scene_drawable->visible = false;
+	health_scene_drawable->visible = false;
+	border_scene_drawable->visible = false;
+	gun_scene_drawables[gameplay.gun_mode]->visible = false;
 
 	hovering_text = 0;
 	if (did_clear) {
@@ -1210,7 +1035,10 @@ void PlayMode::game_over(bool did_clear) {
 bool PlayMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size) {
 
 	if (evt.type == SDL_KEYDOWN) {
-		if (evt.key.keysym.sym == SDLK_EQUALS) {
+		if (evt.key.keysym.sym == SDLK_F3) {
+			show_draw_stats = !show_draw_stats;
+			return true;
+		} else if (evt.key.keysym.sym == SDLK_EQUALS) {
 			mouse_sens = (mouse_sens + mouse_sens_inc >= mouse_sens_max) ? mouse_sens_max : mouse_sens + mouse_sens_inc;
 			return true;
 		} else if (evt.key.keysym.sym == SDLK_MINUS) {
@@ -1233,15 +1061,18 @@ bool PlayMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size)
 			}
 		} else if (game_state == PLAYING) {
 			if (evt.key.keysym.sym == SDLK_c || evt.key.keysym.sym == SDLK_v) {
-				check_hit();
+				gameplay.check(event_music_time(evt.common.timestamp));
+				present_gameplay();
 				return true;
 			} else if (evt.key.keysym.sym == SDLK_z) {
 				// go to previous gun mode
-				change_gun(-1);
+				gameplay.change_gun(-1);
+				show_gun();
 				return true;
 			} else if (evt.key.keysym.sym == SDLK_x) {
 				// go to next gun mode
-				change_gun(1);
+				gameplay.change_gun(1);
+				show_gun();
 				return true;
 			} else if (evt.key.keysym.sym == SDLK_ESCAPE) {
 				SDL_SetRelativeMouseMode(SDL_FALSE);
@@ -1284,12 +1115,12 @@ bool PlayMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size)
 	}
 	else if (evt.type == SDL_MOUSEBUTTONDOWN) {
 		if (game_state != PLAYING) return true;
-		check_hit();
-		holding = true;
+		gameplay.press(event_music_time(evt.common.timestamp));
+		present_gameplay();
 	} else if (evt.type == SDL_MOUSEBUTTONUP) {
 		if (game_state != PLAYING) return true;
-		holding = false;
-		check_hit(false);
+		gameplay.release(event_music_time(evt.common.timestamp));
+		present_gameplay();
 	} else if (evt.type == SDL_MOUSEMOTION) {
 		if (game_state != PLAYING) return true;
 		
@@ -1299,30 +1130,17 @@ bool PlayMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size)
 		delta.x *= float(window_size.y) / float(window_size.x);
 		delta.y = evt.motion.yrel / float(window_size.y) * -2.0f;
 
-		cam.azimuth -= mouse_sens * delta.x;
-		cam.elevation -= mouse_sens * delta.y;
-
-		cam.azimuth /= 2.0f * 3.1415926f;
-		cam.azimuth = std::clamp(cam.azimuth - std::round(cam.azimuth), -0.05f, 0.05f);
-		cam.azimuth *= 2.0f * 3.1415926f;
-
-		cam.elevation /= 2.0f * 3.1415926f;
-		cam.elevation = std::clamp(cam.elevation - std::round(cam.elevation), 0.2f, 0.3f);
-		cam.elevation *= 2.0f * 3.1415926f;
-
-		//update camera aspect ratio for drawable:
-		camera->transform->rotation =
-			normalize(glm::angleAxis(1280.0f / 720.0f * cam.azimuth, glm::vec3(0.0f, 1.0f, 0.0f))
-			* glm::angleAxis(0.5f * 3.1415926f + -cam.elevation, glm::vec3(1.0f, 0.0f, 0.0f)));
+		// turn the camera (and re-check the hit if holding)
+		gameplay.aim(mouse_sens * delta, event_music_time(evt.common.timestamp));
 
+		camera->transform->rotation = gameplay.camera_rotation;
 		camera->transform->scale = glm::vec3(1.0f);
-		if (holding) {
-			check_hit();
-		}
+		present_gameplay();
 		return true;
-	} else if (holding) {
+	} else if (gameplay.holding) {
 		if (game_state != PLAYING) return true;
-		check_hit();
+		gameplay.check(event_music_time(evt.common.timestamp));
+		present_gameplay();
 		return true;
 	}
 	return false;
@@ -1330,13 +1148,14 @@ bool PlayMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size)
 
 /*
 	Function to call the update functions on the background and notes
+		(update_notes can end the game, so the state is checked again afterwards)
 */
 void PlayMode::update(float elapsed) {
 	if (game_state == PLAYING) {
 		update_bg(elapsed);
-		update_notes(elapsed);
+		update_notes();
 
-		if (song_cleared && std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - song_clear_time).count() > 3.0f) {
+		if (game_state == PLAYING && song_cleared && std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - song_clear_time).count() > 3.0f) {
 			game_over(true);
 		}
 	} else if (game_state == MENU) {
@@ -1359,58 +1178,12 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 
 	camera->aspect = float(drawable_size.x) / float(drawable_size.y);
 
-	//set up light type and position for lit_color_texture_program:
-	// from forward lighting class demo
-	//compute light uniforms:
-	uint32_t lights = uint32_t(6);
-
-	std::vector< int32_t > light_type; light_type.reserve(lights);
-	std::vector< glm::vec3 > light_location; light_location.reserve(lights);
-	std::vector< glm::vec3 > light_direction; light_direction.reserve(lights);
-	std::vector< glm::vec3 > light_energy; light_energy.reserve(lights);
-	std::vector< float > light_cutoff; light_cutoff.reserve(lights);
-
-	light_location.emplace_back(camera->transform->position + glm::vec3(0.0f, 3.0f, 3.0f));
-	light_direction.emplace_back(glm::vec3(0.0f, -0.1f, -1.0f));
-	light_energy.emplace_back(glm::vec3(50.0f, 50.0f, 50.0f));
-	light_type.emplace_back(0);
-	light_cutoff.emplace_back(1.0f);
-
-	light_location.emplace_back(camera->transform->position + glm::vec3(3.0f, 0.0f, -2.0f));
-	light_direction.emplace_back(glm::vec3(1.0f, 0.0f, -1.0f));
-	light_energy.emplace_back(glm::vec3(50.0f, 50.0f, 50.0f));
-	light_type.emplace_back(0);
-	light_cutoff.emplace_back(1.0f);
-	light_location.emplace_back(camera->transform->position + glm::vec3(-3.0f, 0.0f, -2.0f));
-	light_direction.emplace_back(glm::vec3(-1.0f, 0.0f, -1.0f));
-	light_energy.emplace_back(glm::vec3(50.0f, 50.0f, 50.0f));
-	light_type.emplace_back(0);
-	light_cutoff.emplace_back(1.0f);
-	light_location.emplace_back(camera->transform->position + glm::vec3(0.0f, 3.0f, -2.0f));
-	light_direction.emplace_back(glm::vec3(0.0f, 1.0f, -1.0f));
-	light_energy.emplace_back(glm::vec3(50.0f, 50.0f, 50.0f));
-	light_type.emplace_back(0);
-	light_cutoff.emplace_back(1.0f);
-	light_location.emplace_back(camera->transform->position + glm::vec3(0.0f, -3.0f, -2.0f));
-	light_direction.emplace_back(glm::vec3(0.0f, -1.0f, -1.0f));
-	light_energy.emplace_back(glm::vec3(50.0f, 50.0f, 50.0f));
-	light_type.emplace_back(0);
-	light_cutoff.emplace_back(1.0f);
-
-	light_location.emplace_back(camera->transform->position + glm::vec3(0.0f, 3.0f, 50.0f));
-	light_direction.emplace_back(glm::vec3(0.0f, 0.0f, -1.0f));
-	light_energy.emplace_back(glm::vec3(10000.0f, 10000.0f, 10000.0f));
-	light_type.emplace_back(2);
-	light_cutoff.emplace_back(1.0f);
-
-	glUseProgram(lit_color_texture_program->program);
-	glUniform1ui(lit_color_texture_program->LIGHTS_uint, lights);
-	glUniform1iv(lit_color_texture_program->LIGHT_TYPE_int, lights, light_type.data());
-	glUniform3fv(lit_color_texture_program->LIGHT_LOCATION_vec3, lights, glm::value_ptr(light_location[0]));
-	glUniform3fv(lit_color_texture_program->LIGHT_DIRECTION_vec3, lights, glm::value_ptr(light_direction[0]));
-	glUniform3fv(lit_color_texture_program->LIGHT_ENERGY_vec3, lights, glm::value_ptr(light_energy[0]));
-	glUniform1fv(lit_color_texture_program->LIGHT_CUTOFF_float, lights, light_cutoff.data());
-	glUseProgram(0);
+	// lights keep their offsets from the camera's position (see camera_lights);
+	// the shared light block is only rewritten when that moves them
+	for (auto const &camera_light : camera_lights) {
+		camera_light.first->position = camera->transform->position + camera_light.second;
+	}
+	lit_color_texture_program->set_lights(scene.lights);
 
 	glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
 	glClearDepth(1.0f);
@@ -1419,7 +1192,9 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 	glEnable(GL_DEPTH_TEST);
 	glDepthFunc(GL_LESS);
 
+	scene.update_world_matrices();
 	scene.draw(*camera);
+	draw_notes(camera->make_projection() * glm::mat4(camera->transform->make_world_to_local()));
 
 	{ //use DrawLines to overlay some text:
 		glDisable(GL_DEPTH_TEST);
@@ -1468,27 +1243,26 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 					);
 				}
 			}
-			lines.draw_text(std::to_string(score),
+			lines.draw_text(std::to_string(gameplay.score),
 				glm::vec3(aspect - 0.3f - ofs, 0.8f, 0.0f),
 				glm::vec3(H, 0.0f, 0.0f), glm::vec3(0.0f, H, 0.0f),
 				glm::u8vec4(0xff, 0xff, 0xff, 0x00));
 
-			lines.draw_text("x" + std::to_string(combo),
+			lines.draw_text("x" + std::to_string(gameplay.combo),
 				glm::vec3(aspect - 0.3f - ofs, 0.0f, 0.0f),
 				glm::vec3(H, 0.0f, 0.0f), glm::vec3(0.0f, H, 0.0f),
 				glm::u8vec4(0xff, 0xff, 0xff, 0x00));
 
 			std::string gun_mode_text = "SINGLE";
-			if (gun_mode == 1) gun_mode_text = "BURST";
-			else if (gun_mode == 2) gun_mode_text = "HOLD";
+			if (gameplay.gun_mode == 1) gun_mode_text = "BURST";
+			else if (gameplay.gun_mode == 2) gun_mode_text = "HOLD";
 			lines.draw_text(gun_mode_text,
 				glm::vec3(-aspect + 0.3f + ofs, 0.8f, 0.0f),
 				glm::vec3(H, 0.0f, 0.0f), glm::vec3(0.0f, H, 0.0f),
 				glm::u8vec4(0xff, 0xff, 0xff, 0x00));
 			
-			if (is_tutorial) {
-				auto current_time = std::chrono::high_resolution_clock::now();
-				float music_time = std::chrono::duration<float>(current_time - music_start_time).count();
+			if (gameplay.is_tutorial) {
+				float music_time = get_music_time();
 				if (music_time < 16.0f) {
 					lines.draw_text("Click enemies when they touch the square border",
 						glm::vec3(-aspect + 0.3f + ofs, -0.8f, 0.0f),
@@ -1543,12 +1317,12 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 					glm::vec3(H, 0.0f, 0.0f), glm::vec3(0.0f, H, 0.0f),
 					glm::u8vec4(0xff, 0xff, 0xff, 0x00));
 			}
-			lines.draw_text(std::to_string(score),
+			lines.draw_text(std::to_string(gameplay.score),
 				glm::vec3(aspect - 0.3f - ofs, 0.8f, 0.0f),
 				glm::vec3(H, 0.0f, 0.0f), glm::vec3(0.0f, H, 0.0f),
 				glm::u8vec4(0xff, 0xff, 0xff, 0x00));
 
-			lines.draw_text("x" + std::to_string(combo),
+			lines.draw_text("x" + std::to_string(gameplay.combo),
 				glm::vec3(aspect - 0.3f - ofs, 0.0f, 0.0f),
 				glm::vec3(H, 0.0f, 0.0f), glm::vec3(0.0f, H, 0.0f),
 				glm::u8vec4(0xff, 0xff, 0xff, 0x00));
@@ -1569,12 +1343,12 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 				glm::vec3(H, 0.0f, 0.0f), glm::vec3(0.0f, H, 0.0f),
 				glm::u8vec4(0xff, 0xff, 0xff, 0x00));
 
-			lines.draw_text("SCORE: " + std::to_string(score),
+			lines.draw_text("SCORE: " + std::to_string(gameplay.score),
 				glm::vec3(-0.3f, 0.2f, 0.0f),
 				glm::vec3(H, 0.0f, 0.0f), glm::vec3(0.0f, H, 0.0f),
 				glm::u8vec4(0xff, 0xff, 0xff, 0x00));
 
-			lines.draw_text("MAX COMBO: " + std::to_string(max_combo),
+			lines.draw_text("MAX COMBO: " + std::to_string(gameplay.max_combo),
 				glm::vec3(-0.3f, 0.0f, 0.0f),
 				glm::vec3(H, 0.0f, 0.0f), glm::vec3(0.0f, H, 0.0f),
 				glm::u8vec4(0xff, 0xff, 0xff, 0x00));
@@ -1595,6 +1369,19 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 				glm::vec3(H, 0.0f, 0.0f), glm::vec3(0.0f, H, 0.0f),
 				glm::u8vec4(0xff, 0xff, 0xff, 0x00));
 		}
+
+		if (show_draw_stats) {
+			Scene::DrawStats const &stats = scene.draw_stats;
+			lines.draw_text("DRAWS " + std::to_string(stats.drawables)
+				+ "  CULLED " + std::to_string(stats.culled)
+				+ "  STATE CHANGES " + std::to_string(stats.state_changes())
+				+ " (" + std::to_string(stats.programs) + " PROGRAM, "
+				+ std::to_string(stats.vertex_arrays) + " VAO, "
+				+ std::to_string(stats.textures) + " TEXTURE)",
+				glm::vec3(-aspect + 0.1f + ofs, -0.95f, 0.0f),
+				glm::vec3(0.5f * H, 0.0f, 0.0f), glm::vec3(0.0f, 0.5f * H, 0.0f),
+				glm::u8vec4(0xff, 0xff, 0x00, 0x00));
+		}
 	}
 	GL_ERRORS();
 }
@@ -1,60 +1,42 @@
 #include "Mode.hpp"
 
 #include "Scene.hpp"
+#include "NoteProgram.hpp"
 #include "WalkMesh.hpp"
 #include "Sound.hpp"
 #include "Mesh.hpp"
+#include "Beatmap.hpp"
+#include "NoteStore.hpp"
+#include "Gameplay.hpp"
+#include "ReplayLog.hpp"
 
 #include <glm/glm.hpp>
 
 #include <vector>
-#include <deque>
+#include <array>
+#include <limits>
 #include <chrono>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 
 struct Drawable {
 	GLenum type = GL_TRIANGLES;
 	GLuint start = 0;
 	GLuint count = 0; 
+	glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity()); // bounds (as in Scene::Drawable)
+	glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
 };
 
-// Note types
-enum NoteType : uint16_t {
-	SINGLE,
-	HOLD,
-	BURST,
-};
-
-// Struct containing informations relevant to a single note
-// TODO: Consider which informations is really necessary
-// TODO: change the vectors to singular values
-struct NoteInfo {
-	int note_idx;
-
-	std::vector<Scene::Transform *> note_transforms;
-	std::vector<float> hit_times;
-	NoteType noteType = NoteType::SINGLE;
-	std::string dir;
-	float coord_begin;
-	float coord_end;
-
-	glm::vec3 min = glm::vec3();
-	glm::vec3 max = glm::vec3();
-
-	glm::vec3 scale = glm::vec3();
-
-	// We need both beenHit and isActive because otherwise notes that has been
-	// hit will keep re-activating
-	bool been_hit = false;
-	bool is_active = false;
-
-	float delete_time = 0.5f;
-};
+// Notes of one song, built from its beatmap once (on a worker thread) and reused every time the song starts
+struct SongNotes {
+	// min/max are filled in from the active skin when the song starts
+	NoteStore notes;
 
-// struct for intersection functions
-struct HitInfo {
-	struct NoteInfo *note;
-	float time;
+	// placement each note transform starts each play at, one per segment
+	std::vector<Gameplay::Placement> placements;
 };
 
 struct PlayMode : Mode {
@@ -69,23 +51,35 @@ struct PlayMode : Mode {
 	virtual void draw(glm::uvec2 const &drawable_size) override;
 
 	// initialization functions to make a notes vector from a beatmap
-	void read_notes(std::string song_name);
- 	glm::vec2 get_coords(std::string dir, float coord);
+	void preload_songs();
+	void build_song_notes(std::string const &beatmap_path, SongNotes *song_notes) const;
+	void read_notes(int song_idx);
+	void hide_notes();
+	void set_note_mesh(uint32_t segment, uint8_t mesh);
 	
 
+	// song position (in seconds)
+	float get_music_time() const;
+	float event_music_time(uint32_t timestamp) const;
+
 	// update functions - background and notes
 	void update_bg(float elapsed);
-	void update_notes(float elapsed);
+	void update_notes();
 	void set_health_bar();
 
-	// intersection functions to hit notes
-	bool bbox_intersect(glm::vec3 pos, glm::vec3 dir, glm::vec3 min, glm::vec3 max, float &t);
-	HitInfo trace_ray(glm::vec3 pos, glm::vec3 dir);
-	void check_hit(bool mouse_down);
-	void set_combo(int diff);
-	void hit_note(NoteInfo* note, int hit_status);
+	// presenting gameplay - shows what happened since last time
+	void present_gameplay();
+	void show_judgement(int note_idx, int hit_status);
+	void show_gun();
 
-	void change_gun(int idx_change, int manual_idx);
+	// drawing notes (instanced, see NoteProgram.hpp)
+	void build_note_instances();
+	void draw_notes(glm::mat4 const &world_to_clip);
+
+	// hands the recording of the song in progress (if any) to replay_saver, which writes it to replay_path
+	void save_replay();
+	// body of replay_saver
+	void run_replay_saver();
 
 	// game state related functions
 	void reset_song();
@@ -105,11 +99,25 @@ struct PlayMode : Mode {
 		GAMEOVER,
 	} game_state;
 
-	// variable to keep track if mouse click is being held down
-	bool holding = false;
+	// rules of the song being played (notes, aiming, score / combo / health)
+	Gameplay gameplay;
+
+	// recording of the song being played, saved when it ends
+	ReplayLog replay;
+	bool replay_pending = false;
+	std::string replay_path;
+	// ended recordings are written on replay_saver, so ending or restarting a song doesn't wait on the disk:
+	// save_replay swaps the recording with replay_to_save (so neither side allocates) and wakes the saver
+	ReplayLog replay_to_save; // only touched by replay_saver while replay_save_queued
+	bool replay_save_queued = false; // (guarded by replay_save_mutex, like replay_saver_quit)
+	bool replay_saver_quit = false;
+	std::mutex replay_save_mutex;
+	std::condition_variable replay_save_cv;
+	std::thread replay_saver;
 
 	// local copy of the game scene
 	Scene scene;
+	bool show_draw_stats = false; // F3 toggles an overlay of Scene::draw_stats
 
 	// pointer to camera to manipulate
 	Scene::Camera *camera = nullptr;
@@ -117,11 +125,29 @@ struct PlayMode : Mode {
 	// background scrolling
 	std::vector<Scene::Transform *> bg_transforms;
 
+	// lights, each kept at an offset from the camera's position
+	std::vector<std::pair<Scene::Transform *, glm::vec3>> camera_lights;
+
 	// assets
 	MeshBuffer const *meshBuf;
 
-	// vector containing all note infos of a song
-	std::vector<NoteInfo> notes;
+	// notes aren't scene drawables: they're drawn after the scene, one instanced draw per mesh (see draw_notes)
+	// meshes notes can show: the active skin's, then the "hit" meshes
+	enum : uint8_t { HitMissMesh = 10, HitGoodMesh, HitPerfectMesh, NoteMeshCount };
+	std::array<Drawable, NoteMeshCount> note_meshes;
+	// mesh of each note segment (index into note_meshes)
+	std::vector<uint8_t> segment_mesh;
+	// instances of the live note segments, grouped by mesh: mesh m has instances [offsets[m], offsets[m+1])
+	// rebuilt only when notes spawn, retire or change mesh -- notes move in the vertex shader
+	std::vector<NoteProgram::Instance> note_instances;
+	std::array<uint32_t, NoteMeshCount + 1> note_instance_offsets = {};
+	bool note_instances_dirty = false;
+	bool notes_shown = false;
+	float notes_time = 0.0f; // song time notes are drawn at (held while paused or after the song ends)
+	GLuint note_instance_buffer = 0;
+	GLsizeiptr note_instance_capacity = 0; // bytes allocated for note_instance_buffer (it only grows)
+	GLuint note_instance_vao = 0;
+	NoteProgram const *note_variant = nullptr; // note_program built for the scene's lights (set up with them in the constructor)
 
 	// storage for perfect / good / miss hits
 	Drawable hit_perfect;
@@ -135,36 +161,43 @@ struct PlayMode : Mode {
 	// vector containing list of songs
 	std::vector< std::pair<std::string, Sound::Sample> > song_list;
 
+	// prebuilt notes for each song in song_list, filled in by the preload workers
+	std::vector<SongNotes> song_notes;
+	std::vector< std::shared_future<void> > song_notes_ready;
+	std::vector<std::thread> preload_workers;
+
 	// health bar
+	// (HUD pieces are shown and hidden with Scene::Drawable::visible, through the *_scene_drawable pointers)
 	Drawable healthbar_drawable;
 	Scene::Transform *healthbar_transform = nullptr;
+	Scene::Drawable *healthbar_scene_drawable = nullptr;
 	Drawable healthbarleft_drawable;
 	Scene::Transform *healthbarleft_transform = nullptr;
+	Scene::Drawable *healthbarleft_scene_drawable = nullptr;
 	Drawable healthbarright_drawable;
 	Scene::Transform *healthbarright_transform = nullptr;
+	Scene::Drawable *healthbarright_scene_drawable = nullptr;
 	glm::vec3 const healthbar_position = glm::vec3(-0.28f, 0.4f, -2.0f); // TODO: change this
 	glm::vec3 const healthbar_scale = glm::vec3(0.4f, 0.3f, 0.3f);
 	glm::vec3 const healthbar_LR_scale = glm::vec3(1.0f);
 	Drawable health_drawable;
 	Scene::Transform *health_transform = nullptr;
+	Scene::Drawable *health_scene_drawable = nullptr;
 
 	// gun information
 	Drawable gun_drawable;
 	std::vector<Scene::Transform *> gun_transforms;
+	std::vector<Scene::Drawable *> gun_scene_drawables;
 	glm::vec3 const gun_scale = glm::vec3(0.03f, 0.03f, 0.03f);
-	int gun_mode = 0; // 0 = single, 1 = burst, 2 = hold
 
 	// border information
 	Drawable border_drawable;
 	Scene::Transform *border_transform = nullptr;
-	float x_scale = 1.0f;
-	float y_scale = 1.0f;
+	Scene::Drawable *border_scene_drawable = nullptr;
 	float z_scale = 0.01f;
 
 	// music & SFX
 	bool has_started = false;
-	std::chrono::time_point<std::chrono::high_resolution_clock> music_start_time;
-	std::chrono::time_point<std::chrono::high_resolution_clock> music_pause_time;
 	std::shared_ptr< Sound::PlayingSample > active_song;
 	Sound::Sample note_hit_sound;
 	Sound::Sample note_miss_sound;
@@ -172,21 +205,10 @@ struct PlayMode : Mode {
 	//background music
 	std::shared_ptr< Sound::PlayingSample > bg_loop;
 	
-	// gameplay
-	int note_start_idx = 0;
-	int note_end_idx = 0;
-
-	int score = 0;
-	int combo = 0;
-	int max_combo = 0;
-	int multiplier = 1;
-	float health = 0.7f;
-	float const max_health = 1.0f;
+	// health bar display
 	float const health_right_cutoff = 0.97f;
 	float const health_left_cutoff = 0.01f;
 
-	bool is_tutorial = false;
-
 	bool song_cleared = false;
 	std::chrono::time_point<std::chrono::high_resolution_clock> song_clear_time;
 
@@ -196,44 +218,18 @@ struct PlayMode : Mode {
 	uint8_t hovering_text = 0;
 	int chosen_song = 0;
 
-	// settings
-	// TODO : should include some scaling variable to allow for different note speed settings to automatically affect these
-	float init_note_depth = -20.0f;
-	// TODO : this is different from the border that is being visually displayed?
-	float border_depth = 0.0f;
+	// settings (note settings are in gameplay)
 	float max_depth = 10.0f;
-	
-	float note_approach_time = 4.0f; // time between when the note shows up and hit time
-	float valid_hit_time_delta = 0.5f;
-	float real_song_offset = 0.00f;
-	float note_speed = (border_depth - init_note_depth) / note_approach_time;
 
-	float bgscale = abs(init_note_depth - max_depth);;
+	float bgscale = abs(gameplay.init_note_depth - max_depth);;
 
 	float mouse_sens = 0.4f;
 	float const mouse_sens_min = 0.1f;
 	float const mouse_sens_max = 1.0f;
 	float const mouse_sens_inc = 0.1f;
 
-	// from ShowSceneMode.hpp to fix the up axis
-	struct {
-		float radius = 2.0f;
-		float azimuth = 0.0f; //angle ccw of -y axis, in radians, [-pi,pi]
-		float elevation = 3.1415926f / 2.0f; //angle above ground, in radians, [-pi,pi]
-		glm::vec3 target = glm::vec3(0.0f);
-		bool flip_x = false; //flip x inputs when moving? (used to handle situations where camera is upside-down)
-	} cam;
 	void reset_cam() { 
-		cam.radius = 2.0f;
-		cam.azimuth = 0.0f;
-		cam.elevation = 3.1415926f / 2.0f;
-		cam.target = glm::vec3(0.0f);
-		cam.flip_x = false;
-
-		//update camera aspect ratio for drawable:
-		camera->transform->rotation =
-			normalize(glm::angleAxis(cam.azimuth, glm::vec3(0.0f, 1.0f, 0.0f))
-			* glm::angleAxis(0.5f * 3.1415926f + -cam.elevation, glm::vec3(1.0f, 0.0f, 0.0f)))
-		;
+		gameplay.reset_cam();
+		camera->transform->rotation = gameplay.camera_rotation;
 	}
 };
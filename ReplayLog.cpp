@@ -0,0 +1,72 @@
+#include "ReplayLog.hpp"
+
+#include "read_write_chunk.hpp"
+
+#include <cassert>
+#include <fstream>
+#include <type_traits>
+
+//local (to this file) helper: like write_chunk, but straight from existing storage (so save() doesn't copy into temporaries):
+template< typename T >
+static void write_chunk_from(char const (&magic)[5], T const *from, size_t count, std::ostream *to_) {
+	static_assert(std::is_trivially_copyable< T >::value, "chunk data is written as bytes");
+	assert(to_);
+	auto &to = *to_;
+
+	uint32_t size = uint32_t(count * sizeof(T));
+	to.write(magic, 4);
+	to.write(reinterpret_cast< const char * >(&size), sizeof(size));
+	to.write(reinterpret_cast< const char * >(from), count * sizeof(T));
+}
+
+ReplayLog::ReplayLog(std::string const &filename) {
+	std::ifstream file(filename, std::ios::binary);
+	if (!file) {
+		throw std::runtime_error("Failed to open replay '" + filename + "'.");
+	}
+
+	std::vector< Header > headers;
+	read_chunk(file, "rph0", &headers);
+	if (headers.size() != 1) {
+		throw std::runtime_error("Replay '" + filename + "' should have exactly one header.");
+	}
+	header = headers[0];
+	if (header.version != Header().version) {
+		throw std::runtime_error("Replay '" + filename + "' has version " + std::to_string(header.version) + ", expecting " + std::to_string(Header().version) + ".");
+	}
+
+	std::vector< char > song_chars;
+	read_chunk(file, "rps0", &song_chars);
+	song.assign(song_chars.begin(), song_chars.end());
+
+	read_chunk(file, "rpn0", &skin_min);
+	read_chunk(file, "rpx0", &skin_max);
+	if (skin_min.size() != skin_max.size()) {
+		throw std::runtime_error("Replay '" + filename + "' has mismatched skin bounds.");
+	}
+
+	read_chunk(file, "rpi0", &inputs);
+	read_chunk(file, "rpc0", &checkpoints);
+}
+
+void ReplayLog::save(std::string const &filename) const {
+	std::ofstream file(filename, std::ios::binary);
+	write_chunk_from("rph0", &header, 1, &file);
+	write_chunk_from("rps0", song.data(), song.size(), &file);
+	write_chunk_from("rpn0", skin_min.data(), skin_min.size(), &file);
+	write_chunk_from("rpx0", skin_max.data(), skin_max.size(), &file);
+	write_chunk_from("rpi0", inputs.data(), inputs.size(), &file);
+	write_chunk_from("rpc0", checkpoints.data(), checkpoints.size(), &file);
+	if (!file) {
+		throw std::runtime_error("Failed to write replay '" + filename + "'.");
+	}
+}
+
+void ReplayLog::clear() {
+	header = Header();
+	song.clear();
+	skin_min.clear();
+	skin_max.clear();
+	inputs.clear();
+	checkpoints.clear();
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+/*
+ * A ReplayLog is a recording of one play of a song: every input Gameplay was
+ *  given, stamped with the simulation step it was applied at and the song time
+ *  it was judged at, plus periodic checkpoints of the score, combo and health.
+ *
+ * Because Gameplay runs in fixed steps, feeding the inputs back at the same
+ *  steps reproduces the play exactly; replay-gameplay does this headless and
+ *  compares its checkpoints against the recorded ones.
+ *
+ * Files ('.replay') are a sequence of read_chunk-style chunks.
+ *
+ */
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct ReplayLog {
+	ReplayLog() = default;
+	//load a log written by save():
+	ReplayLog(std::string const &filename);
+
+	void save(std::string const &filename) const;
+
+	//empty the log (keeps nothing from a previous recording):
+	void clear();
+
+	struct Header {
+		uint32_t version = 1;
+		float step_time = 0.0f; //Gameplay::StepTime when recorded
+		uint32_t is_tutorial = 0;
+		float camera_position[3] = {0.0f, 0.0f, 0.0f};
+	};
+	static_assert(sizeof(Header) == 24, "Header is packed.");
+	Header header;
+
+	//name of the song (its beatmap is dist/beatmaps/<song>.beatc or .txt):
+	std::string song;
+
+	//local min/max corners of the meshes of the skin the song was played with, by note skin index:
+	std::vector< glm::vec3 > skin_min;
+	std::vector< glm::vec3 > skin_max;
+
+	struct Input {
+		enum Type : uint8_t {
+			Aim, //(x,y) = mouse delta, scaled by sensitivity
+			Press, //mouse button down
+			Release, //mouse button up
+			Check, //hit key, or any other event while holding
+			Gun, //(change, manual) = arguments to Gameplay::change_gun
+		};
+		uint32_t step = 0; //Gameplay::steps when the input was applied
+		float time = 0.0f; //song time the input was judged at
+		uint8_t type = Aim;
+		int8_t change = 0;
+		int8_t manual = -1;
+		uint8_t padding = 0;
+		float x = 0.0f;
+		float y = 0.0f;
+	};
+	static_assert(sizeof(Input) == 20, "Input is packed.");
+	std::vector< Input > inputs;
+
+	struct Checkpoint {
+		uint32_t step = 0;
+		int32_t score = 0;
+		int32_t combo = 0;
+		int32_t max_combo = 0;
+		float health = 0.0f;
+	};
+	static_assert(sizeof(Checkpoint) == 20, "Checkpoint is packed.");
+	std::vector< Checkpoint > checkpoints;
+};
@@ -5,6 +5,7 @@
 
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
 #include <fstream>
 
 //-------------------------
@@ -57,18 +58,84 @@ glm::mat4x3 Scene::Transform::make_parent_to_local() const {
 }
 
 glm::mat4x3 Scene::Transform::make_local_to_world() const {
-	if (!parent) {
-		return make_local_to_parent();
-	} else {
-		return parent->make_local_to_world() * glm::mat4(make_local_to_parent()); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
-	}
+	update_world_cache();
+	return world_cache.local_to_world;
 }
 glm::mat4x3 Scene::Transform::make_world_to_local() const {
+	update_world_cache();
+	return world_cache.world_to_local;
+}
+
+void Scene::Transform::update_world_cache() const {
+	WorldCache &cache = world_cache;
+	if (parent) parent->update_world_cache();
+
+	uint32_t current_parent_version = (parent ? parent->world_cache.version : 0);
+	if (cache.version != 0
+	 && cache.position == position && cache.rotation == rotation && cache.scale == scale
+	 && cache.parent == parent && cache.parent_version == current_parent_version) {
+		return; //nothing changed since the last rebuild
+	}
+
+	glm::mat4x3 local_to_world, world_to_local;
 	if (!parent) {
-		return make_parent_to_local();
+		local_to_world = make_local_to_parent();
+		world_to_local = make_parent_to_local();
 	} else {
-		return make_parent_to_local() * glm::mat4(parent->make_world_to_local()); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+		//note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+		local_to_world = parent->world_cache.local_to_world * glm::mat4(make_local_to_parent());
+		world_to_local = make_parent_to_local() * glm::mat4(parent->world_cache.world_to_local);
+	}
+
+	cache.position = position;
+	cache.rotation = rotation;
+	cache.scale = scale;
+	cache.parent = parent;
+	cache.parent_version = current_parent_version;
+	if (cache.version != 0 && cache.local_to_world == local_to_world && cache.world_to_local == world_to_local) {
+		return; //same matrices, so nothing that depends on them needs rebuilding
 	}
+	cache.local_to_world = local_to_world;
+	cache.world_to_local = world_to_local;
+	cache.version += 1;
+	if (cache.version == 0) cache.version = 1; //(0 is reserved for "never built")
+}
+
+//-------------------------
+
+void Scene::Drawable::update_world_bounds() const {
+	WorldBounds &bounds = world_bounds;
+	transform->update_world_cache();
+
+	if (bounds.transform_version != 0
+	 && bounds.transform == transform && bounds.transform_version == transform->world_cache.version
+	 && bounds.local_min == min && bounds.local_max == max) {
+		return; //nothing changed since the last rebuild
+	}
+
+	glm::mat4x3 const &local_to_world = transform->world_cache.local_to_world;
+
+	//if the transform has rank < 2, every triangle it draws has zero area:
+	glm::vec3 const &x = local_to_world[0], &y = local_to_world[1], &z = local_to_world[2];
+	glm::vec3 const zero = glm::vec3(0.0f);
+	bounds.flat = (glm::cross(x, y) == zero && glm::cross(y, z) == zero && glm::cross(z, x) == zero);
+
+	bounds.known = (min.x <= max.x && min.y <= max.y && min.z <= max.z);
+	if (bounds.known) {
+		//box around the transformed box: transform its center, and sum each axis' contribution to the extent
+		// (as in Arvo, "Transforming Axis-Aligned Bounding Boxes", Graphics Gems, 1990)
+		glm::vec3 center = 0.5f * (min + max);
+		glm::vec3 radius = 0.5f * (max - min);
+		glm::vec3 world_center = local_to_world * glm::vec4(center, 1.0f);
+		glm::vec3 world_radius = glm::abs(x) * radius.x + glm::abs(y) * radius.y + glm::abs(z) * radius.z;
+		bounds.min = world_center - world_radius;
+		bounds.max = world_center + world_radius;
+	}
+
+	bounds.local_min = min;
+	bounds.local_max = max;
+	bounds.transform = transform;
+	bounds.transform_version = transform->world_cache.version;
 }
 
 //-------------------------
@@ -79,6 +146,41 @@ glm::mat4 Scene::Camera::make_projection() const {
 
 //-------------------------
 
+bool Scene::Material::operator==(Material const &other) const {
+	if (program != other.program) return false;
+	if (OBJECT_TO_CLIP_mat4 != other.OBJECT_TO_CLIP_mat4) return false;
+	if (OBJECT_TO_LIGHT_mat4x3 != other.OBJECT_TO_LIGHT_mat4x3) return false;
+	if (NORMAL_TO_LIGHT_mat3 != other.NORMAL_TO_LIGHT_mat3) return false;
+	if (uniform_buffer != other.uniform_buffer || uniform_binding != other.uniform_binding) return false;
+	for (uint32_t i = 0; i < TextureCount; ++i) {
+		if (textures[i].texture != other.textures[i].texture || textures[i].target != other.textures[i].target) return false;
+	}
+	return true;
+}
+
+//(a deque, so references from Scene::material stay valid as materials are added)
+static std::deque< Scene::Material > &interned_materials() {
+	static std::deque< Scene::Material > materials(1); //index 0 is Material()
+	return materials;
+}
+
+uint32_t Scene::intern_material(Material const &material) {
+	std::deque< Material > &materials = interned_materials();
+	//(materials are made while setting up drawables and there are few of them, so a scan is fine)
+	for (uint32_t i = 0; i < materials.size(); ++i) {
+		if (materials[i] == material) return i;
+	}
+	materials.emplace_back(material);
+	return uint32_t(materials.size() - 1);
+}
+
+Scene::Material const &Scene::material(uint32_t index) {
+	assert(index < interned_materials().size());
+	return interned_materials()[index];
+}
+
+//-------------------------
+
 
 void Scene::draw(Camera const &camera) const {
 	assert(camera.transform);
@@ -87,26 +189,163 @@ void Scene::draw(Camera const &camera) const {
 	draw(world_to_clip, world_to_light);
 }
 
+//Packed sort key for a pipeline: drawables sharing a program sort together, then those sharing a material, then a vao, then mesh:
+// (fields are truncated to 16 bits, which only affects how well the list groups -- binds are skipped by exact comparison)
+static uint64_t pipeline_key(Scene::Drawable::Pipeline const &pipeline, Scene::Material const &material) {
+	return (uint64_t(material.program & 0xffff) << 48)
+	     | (uint64_t(pipeline.material & 0xffff) << 32)
+	     | (uint64_t(pipeline.vao & 0xffff) << 16)
+	     | uint64_t(pipeline.start & 0xffff);
+}
+
+//local (to this file) culling and state tracking for Scene::draw:
+namespace {
+
+	//The six planes bounding the view volume of world_to_clip, as (normal, offset) with dot(normal, p) + offset >= 0 inside:
+	// (Gribb and Hartmann, "Fast Extraction of Viewing Frustum Planes from the World-View-Projection Matrix", 2001)
+	// n.b. the far plane of an infinite perspective comes out as (0,0,0,+), which everything is inside
+	struct Frustum {
+		Frustum(glm::mat4 const &world_to_clip) {
+			glm::vec4 row[4];
+			for (uint32_t r = 0; r < 4; ++r) {
+				row[r] = glm::vec4(world_to_clip[0][r], world_to_clip[1][r], world_to_clip[2][r], world_to_clip[3][r]);
+			}
+			for (uint32_t a = 0; a < 3; ++a) {
+				planes[2 * a + 0] = row[3] + row[a];
+				planes[2 * a + 1] = row[3] - row[a];
+			}
+		}
+		glm::vec4 planes[6];
+
+		//is any of the box [min,max] inside? (conservative: boxes near corners may pass while outside)
+		bool overlaps(glm::vec3 const &min, glm::vec3 const &max) const {
+			glm::vec3 center = 0.5f * (min + max);
+			glm::vec3 radius = 0.5f * (max - min);
+			for (glm::vec4 const &plane : planes) {
+				glm::vec3 normal = glm::vec3(plane);
+				float distance = glm::dot(normal, center) + plane.w;
+				float reach = glm::dot(glm::abs(normal), radius);
+				if (distance + reach < 0.0f) return false;
+			}
+			return true;
+		}
+	};
+
+	//GL state as set by Scene::draw, so that binds which wouldn't change anything can be skipped:
+	struct DrawState {
+		DrawState(Scene::DrawStats &stats_) : stats(stats_) { }
+		Scene::DrawStats &stats;
+
+		GLuint program = -1U; //(-1U = unknown, so the first use always binds)
+		GLuint vao = -1U;
+		GLuint active_texture = -1U;
+		//texture units start out unbound (as Scene::draw leaves them):
+		Scene::Material::TextureInfo textures[Scene::Material::TextureCount];
+
+		void use_program(GLuint program_) {
+			if (program_ == program) return;
+			glUseProgram(program_);
+			program = program_;
+			stats.programs += 1;
+		}
+
+		void bind_vertex_array(GLuint vao_) {
+			if (vao_ == vao) return;
+			glBindVertexArray(vao_);
+			vao = vao_;
+			stats.vertex_arrays += 1;
+		}
+
+		//bind 'texture' (or unbind, if zero) on texture unit 'unit':
+		void bind_texture(uint32_t unit, GLenum target, GLuint texture) {
+			Scene::Material::TextureInfo &bound = textures[unit];
+			if (bound.texture == texture && (texture == 0 || bound.target == target)) return;
+
+			if (active_texture != unit) {
+				glActiveTexture(GL_TEXTURE0 + unit);
+				active_texture = unit;
+			}
+			//(a texture bound to another target would stay bound alongside the new one, so unbind it)
+			if (bound.texture != 0 && (texture == 0 || bound.target != target)) {
+				glBindTexture(bound.target, 0);
+				stats.textures += 1;
+			}
+			if (texture != 0) {
+				glBindTexture(target, texture);
+				stats.textures += 1;
+			}
+			bound.texture = texture;
+			if (texture != 0) bound.target = target;
+		}
+	};
+}
+
 void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light) const {
+	draw_stats = DrawStats();
+	Frustum frustum(world_to_clip);
 
-	//Iterate through all drawables, sending each one to OpenGL:
+	//Gather all drawables that can be seen, sorted by pipeline state:
+	draw_list.clear();
 	for (auto const &drawable : drawables) {
-		//Reference to drawable's pipeline for convenience:
+		//skip any drawables that are hidden:
+		if (!drawable.visible) continue;
+
+		//Reference to drawable's pipeline (and its material) for convenience:
 		Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
+		Scene::Material const &material = Scene::material(pipeline.material);
 
 		//skip any drawables without a shader program set:
-		if (pipeline.program == 0) continue;
+		if (material.program == 0) continue;
 		//skip any drawables that don't reference any vertex array:
 		if (pipeline.vao == 0) continue;
 		//skip any drawables that don't contain any vertices:
 		if (pipeline.count == 0) continue;
 
+		//skip any drawables that can't be seen:
+		assert(drawable.transform); //drawables *must* have a transform
+		drawable.update_world_bounds();
+		Drawable::WorldBounds const &bounds = drawable.world_bounds;
+		if (bounds.flat || (bounds.known && !frustum.overlaps(bounds.min, bounds.max))) {
+			draw_stats.culled += 1;
+			continue;
+		}
+
+		draw_list.emplace_back(DrawItem{ pipeline_key(pipeline, material), &drawable });
+	}
+	//(stable, so drawables with identical state keep their scene order)
+	std::stable_sort(draw_list.begin(), draw_list.end(), [](DrawItem const &a, DrawItem const &b) {
+		return a.key < b.key;
+	});
+
+	DrawState state(draw_stats);
+	uint32_t current_material = -1U;
+	Scene::Material const *material = nullptr;
+
+	//Send each one to OpenGL:
+	for (DrawItem const &item : draw_list) {
+		Scene::Drawable const &drawable = *item.drawable;
+		Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
+
+		//Set up the material (program, uniform buffer, textures) when it changes:
+		if (pipeline.material != current_material) {
+			current_material = pipeline.material;
+			material = &Scene::material(current_material);
+			draw_stats.materials += 1;
 
-		//Set shader program:
-		glUseProgram(pipeline.program);
+			state.use_program(material->program);
+
+			if (material->uniform_buffer != 0) {
+				glBindBufferBase(GL_UNIFORM_BUFFER, material->uniform_binding, material->uniform_buffer);
+			}
+
+			//(units this material doesn't use are left unbound, as before)
+			for (uint32_t i = 0; i < Material::TextureCount; ++i) {
+				state.bind_texture(i, material->textures[i].target, material->textures[i].texture);
+			}
+		}
 
 		//Set attribute sources:
-		glBindVertexArray(pipeline.vao);
+		state.bind_vertex_array(pipeline.vao);
 
 		//Configure program uniforms:
 
@@ -115,49 +354,35 @@ void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_lig
 		glm::mat4x3 object_to_world = drawable.transform->make_local_to_world();
 
 		//OBJECT_TO_CLIP takes vertices from object space to clip space:
-		if (pipeline.OBJECT_TO_CLIP_mat4 != -1U) {
+		if (material->OBJECT_TO_CLIP_mat4 != -1U) {
 			glm::mat4 object_to_clip = world_to_clip * glm::mat4(object_to_world);
-			glUniformMatrix4fv(pipeline.OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(object_to_clip));
+			glUniformMatrix4fv(material->OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(object_to_clip));
 		}
 
 		//the object-to-light matrix is used in the next two uniforms:
 		glm::mat4x3 object_to_light = world_to_light * glm::mat4(object_to_world);
 
 		//OBJECT_TO_CLIP takes vertices from object space to light space:
-		if (pipeline.OBJECT_TO_LIGHT_mat4x3 != -1U) {
-			glUniformMatrix4x3fv(pipeline.OBJECT_TO_LIGHT_mat4x3, 1, GL_FALSE, glm::value_ptr(object_to_light));
+		if (material->OBJECT_TO_LIGHT_mat4x3 != -1U) {
+			glUniformMatrix4x3fv(material->OBJECT_TO_LIGHT_mat4x3, 1, GL_FALSE, glm::value_ptr(object_to_light));
 		}
 
 		//NORMAL_TO_CLIP takes normals from object space to light space:
-		if (pipeline.NORMAL_TO_LIGHT_mat3 != -1U) {
+		if (material->NORMAL_TO_LIGHT_mat3 != -1U) {
 			glm::mat3 normal_to_light = glm::inverse(glm::transpose(glm::mat3(object_to_light)));
-			glUniformMatrix3fv(pipeline.NORMAL_TO_LIGHT_mat3, 1, GL_FALSE, glm::value_ptr(normal_to_light));
-		}
-
-		//set any requested custom uniforms:
-		if (pipeline.set_uniforms) pipeline.set_uniforms();
-
-		//set up textures:
-		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
-			if (pipeline.textures[i].texture != 0) {
-				glActiveTexture(GL_TEXTURE0 + i);
-				glBindTexture(pipeline.textures[i].target, pipeline.textures[i].texture);
-			}
+			glUniformMatrix3fv(material->NORMAL_TO_LIGHT_mat3, 1, GL_FALSE, glm::value_ptr(normal_to_light));
 		}
 
 		//draw the object:
 		glDrawArrays(pipeline.type, pipeline.start, pipeline.count);
+		draw_stats.drawables += 1;
+	}
 
-		//un-bind textures:
-		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
-			if (pipeline.textures[i].texture != 0) {
-				glActiveTexture(GL_TEXTURE0 + i);
-				glBindTexture(pipeline.textures[i].target, 0);
-			}
-		}
-		glActiveTexture(GL_TEXTURE0);
-
+	//un-bind textures:
+	for (uint32_t i = 0; i < Material::TextureCount; ++i) {
+		state.bind_texture(i, GL_TEXTURE_2D, 0);
 	}
+	glActiveTexture(GL_TEXTURE0);
 
 	glUseProgram(0);
 	glBindVertexArray(0);
@@ -8,14 +8,28 @@
  *  - Camera information (via "Camera")
  *  - Light information (via "Light")
  *
+ * All four are stored in SlotMaps (see SlotMap.hpp): contiguous blocks that are
+ *  scanned linearly, where objects never move (so pointers to them stay valid)
+ *  and handles can be used to refer to objects that may be erased.
+ *
+ * Drawables refer to shared, interned Materials (program, uniform locations,
+ *  textures) by index, so drawables stay small and draw() can batch by material.
+ *
+ * World matrices are computed lazily per transform (see Transform::WorldCache),
+ *  or all at once by update_world_matrices(), which sweeps a flattened copy of
+ *  the hierarchy (see SceneHierarchy.cpp).
+ *
  */
 
 #include "GL.hpp"
+#include "SlotMap.hpp"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 
-#include <list>
+#include <array>
+#include <deque>
+#include <limits>
 #include <memory>
 #include <functional>
 #include <string>
@@ -40,23 +54,98 @@ struct Scene {
 		glm::mat4x3 make_local_to_parent() const;
 		glm::mat4x3 make_parent_to_local() const;
 		// ..relative to the world:
+		// (these are cached, see below)
 		glm::mat4x3 make_local_to_world() const;
 		glm::mat4x3 make_world_to_local() const;
 
+		//World matrices are cached along with the values they were computed from:
+		// the cache is rebuilt only when position / rotation / scale / parent differ from those values,
+		// or when the parent's own cache was rebuilt since (its 'version' changed) -- so changes propagate
+		// to descendants, and fields can still be assigned directly without marking anything dirty.
+		// (a rebuild that gives bit-identical matrices keeps the version, so nothing downstream rebuilds)
+		struct WorldCache {
+			glm::mat4x3 local_to_world = glm::mat4x3(1.0f);
+			glm::mat4x3 world_to_local = glm::mat4x3(1.0f);
+			glm::vec3 position = glm::vec3(0.0f);
+			glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+			glm::vec3 scale = glm::vec3(1.0f);
+			Transform const *parent = nullptr;
+			uint32_t parent_version = 0;
+			uint32_t version = 0; //incremented every rebuild that changes the matrices (0 = never built)
+		};
+		mutable WorldCache world_cache;
+		//bring world_cache up to date (and those of all ancestors):
+		void update_world_cache() const;
+
 		//since hierarchy is tracked through pointers, copy-constructing a transform  is not advised:
 		Transform(Transform const &) = delete;
 		//if we delete some constructors, we need to let the compiler know that the default constructor is still okay:
 		Transform() = default;
 	};
 
+	//A 'Material' is the program-side state a drawable is drawn with:
+	// materials are interned (see intern_material), so drawables with identical state share one index
+	struct Material {
+		GLuint program = 0; //shader program; passed to glUseProgram
+
+		//uniforms:
+		GLuint OBJECT_TO_CLIP_mat4 = -1U; //uniform location for object to clip space matrix
+		GLuint OBJECT_TO_LIGHT_mat4x3 = -1U; //uniform location for object to light space (== world space) matrix
+		GLuint NORMAL_TO_LIGHT_mat3 = -1U; //uniform location for normal to light space (== world space) matrix
+
+		//(optional) uniform buffer holding any other uniforms, bound to uniform block binding point 'uniform_binding':
+		GLuint uniform_buffer = 0;
+		GLuint uniform_binding = 1; //(binding point 0 is the shared light block, see LitColorTextureProgram)
+
+		//texture objects to bind for the first TextureCount textures:
+		enum : uint32_t { TextureCount = 4 };
+		struct TextureInfo {
+			GLuint texture = 0;
+			GLenum target = GL_TEXTURE_2D;
+		} textures[TextureCount];
+
+		bool operator==(Material const &other) const;
+		bool operator!=(Material const &other) const { return !(*this == other); }
+	};
+
+	//index of a material equal to 'material', adding it if there isn't one yet:
+	// (materials are shared by all scenes and never removed; index 0 is Material(), which has no program, so draws nothing)
+	static uint32_t intern_material(Material const &material);
+	//the material at an index returned by intern_material (references stay valid as more are added):
+	static Material const &material(uint32_t index);
+
 	struct Drawable {
 		//a 'Drawable' attaches attribute data to a transform:
 		Drawable(Transform *transform_) : transform(transform_) { assert(transform); }
 		Transform * transform;
 
+		//hidden drawables are skipped by draw() before any other work (no matrices, bounds, or GL calls):
+		// (hide with this rather than a zero scale, which still costs a full draw of degenerate triangles)
+		bool visible = true;
+
+		//Object-space bounding box of the vertices drawn (e.g., Mesh::min / Mesh::max), used to skip drawables out of view:
+		// (the default empty box, with min > max, means "unknown": such drawables are never culled)
+		glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+		glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+
+		//World-space bounding box, cached along with what it was computed from (as in Transform::world_cache):
+		struct WorldBounds {
+			glm::vec3 min = glm::vec3(0.0f);
+			glm::vec3 max = glm::vec3(0.0f);
+			bool known = false; //false if the object-space box is unknown
+			bool flat = false; //true if the transform collapses everything to a line or point (e.g., zero scale), so nothing drawn is visible
+			glm::vec3 local_min = glm::vec3(0.0f);
+			glm::vec3 local_max = glm::vec3(0.0f);
+			Transform const *transform = nullptr;
+			uint32_t transform_version = 0; //(0 = never built)
+		};
+		mutable WorldBounds world_bounds;
+		//bring world_bounds up to date (and the transform's world_cache):
+		void update_world_bounds() const;
+
 		//Contains all the data needed to run the OpenGL pipeline:
 		struct Pipeline {
-			GLuint program = 0; //shader program; passed to glUseProgram
+			uint32_t material = 0; //program, uniforms, and textures (index from Scene::intern_material)
 
 			//attributes:
 			GLuint vao = 0; //attrib->buffer mapping; passed to glBindVertexArray
@@ -64,20 +153,6 @@ struct Scene {
 			GLenum type = GL_TRIANGLES; //what sort of primitive to draw; passed to glDrawArrays
 			GLuint start = 0; //first vertex to draw; passed to glDrawArrays
 			GLuint count = 0; //number of vertices to draw; passed to glDrawArrays
-
-			//uniforms:
-			GLuint OBJECT_TO_CLIP_mat4 = -1U; //uniform location for object to clip space matrix
-			GLuint OBJECT_TO_LIGHT_mat4x3 = -1U; //uniform location for object to light space (== world space) matrix
-			GLuint NORMAL_TO_LIGHT_mat3 = -1U; //uniform location for normal to light space (== world space) matrix
-
-			std::function< void() > set_uniforms; //(optional) function to set any other useful uniforms
-
-			//texture objects to bind for the first TextureCount textures:
-			enum : uint32_t { TextureCount = 4 };
-			struct TextureInfo {
-				GLuint texture = 0;
-				GLenum target = GL_TEXTURE_2D;
-			} textures[TextureCount];
 		} pipeline;
 	};
 
@@ -117,10 +192,51 @@ struct Scene {
 	};
 
 	//Scenes, of course, may have many of the above objects:
-	std::list< Transform > transforms;
-	std::list< Drawable > drawables;
-	std::list< Camera > cameras;
-	std::list< Light > lights;
+	SlotMap< Transform > transforms;
+	SlotMap< Drawable > drawables;
+	SlotMap< Camera > cameras;
+	SlotMap< Light > lights;
+
+	//handles to the above (resolve with, e.g., transforms.get(handle); nullptr once erased):
+	using TransformHandle = SlotMap< Transform >::Handle;
+	using DrawableHandle = SlotMap< Drawable >::Handle;
+	using CameraHandle = SlotMap< Camera >::Handle;
+	using LightHandle = SlotMap< Light >::Handle;
+
+	//The transform hierarchy, flattened for update_world_matrices():
+	struct Hierarchy {
+		//transforms in pre-order: every parent comes before its children, and the subtree of each root is contiguous
+		std::vector< Transform const * > transforms;
+		std::vector< TransformHandle > handles; //(to notice transforms being erased)
+		std::vector< Transform const * > parents; //parent pointers at build time (to notice re-parenting)
+		std::vector< uint32_t > parent_index; //index of parent in 'transforms', or -1U for roots
+		std::vector< uint32_t > roots; //index of each root; root r's subtree ends where root r+1's begins
+		bool external = false; //some parent isn't in this scene (so the pass is not split across threads)
+
+		//per-transform values, gathered as structure-of-arrays at the start of each pass:
+		std::array< std::vector< float >, 3 > position;
+		std::array< std::vector< float >, 4 > rotation; //(x,y,z,w)
+		std::array< std::vector< float >, 3 > scale;
+		//1 where those differ from the transform's world_cache (or it was never built), so its local matrices are recomputed:
+		std::vector< uint8_t > changed;
+		//local matrices computed from them (column-major mat4x3 elements; only up to date where 'changed'):
+		std::array< std::vector< float >, 12 > local_to_parent;
+		std::array< std::vector< float >, 12 > parent_to_local;
+
+		//do the transforms and parents still match those of 'scene'?
+		bool current(Scene const &scene) const;
+		//rebuild from 'scene':
+		void build(Scene const &scene);
+		//compute world matrices of transforms [begin,end) (which must be whole root subtrees) into their world caches:
+		// (as in Transform::update_world_cache, transforms whose values and parent's version match their cache are skipped)
+		void update(uint32_t begin, uint32_t end);
+	};
+	Hierarchy flat_hierarchy;
+
+	//Bring every transform's world matrices (Transform::world_cache) up to date in one pass over 'flat_hierarchy':
+	// (rebuilds 'flat_hierarchy' first if transforms were added, erased, or re-parented)
+	// with threads > 1, large scenes split the pass by root subtree across that many threads
+	void update_world_matrices(uint32_t threads = 1);
 
 	//The "draw" function provides a convenient way to pass all the things in a scene to OpenGL:
 	void draw(Camera const &camera) const;
@@ -128,6 +244,28 @@ struct Scene {
 	//..sometimes, you want to draw with a custom projection matrix and/or light space:
 	void draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light = glm::mat4x3(1.0f)) const;
 
+	//draw() skips drawables whose world bounds are outside the view volume of world_to_clip (before computing any of their uniforms),
+	// then sorts the rest by a packed key of their pipeline state (program, material, vao, mesh),
+	// so drawables sharing state are drawn together: material state is only set when the material changes,
+	// and binds that wouldn't change anything are skipped:
+	struct DrawItem {
+		uint64_t key;
+		Drawable const *drawable;
+	};
+	mutable std::vector< DrawItem > draw_list; //(rebuilt every draw; kept to reuse its storage)
+
+	//counts from the most recent draw():
+	struct DrawStats {
+		uint32_t drawables = 0; //glDrawArrays calls
+		uint32_t culled = 0; //drawables skipped as out of view (or flattened to nothing)
+		uint32_t materials = 0; //material changes
+		uint32_t programs = 0; //glUseProgram calls
+		uint32_t vertex_arrays = 0; //glBindVertexArray calls
+		uint32_t textures = 0; //glBindTexture calls
+		uint32_t state_changes() const { return programs + vertex_arrays + textures; }
+	};
+	mutable DrawStats draw_stats;
+
 	//add transforms/objects/cameras from a scene file to this scene:
 	// the 'on_drawable' callback gives your code a chance to look up mesh data and make Drawables:
 	// throws on file format errors
@@ -0,0 +1,323 @@
+#include "Scene.hpp"
+
+#include <cassert>
+#include <stdexcept>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SCENE_HIERARCHY_SSE 1
+#include <emmintrin.h>
+#endif
+
+//----- arithmetic on one float or four floats, so both paths share one formula -----
+
+static inline float add(float a, float b) { return a + b; }
+static inline float sub(float a, float b) { return a - b; }
+static inline float mul(float a, float b) { return a * b; }
+static inline float divide(float a, float b) { return a / b; }
+static inline float inv_or_zero(float a) { return (a == 0.0f ? 0.0f : 1.0f / a); }
+static inline float splat(float a, float) { return a; }
+
+#ifdef SCENE_HIERARCHY_SSE
+static inline __m128 add(__m128 a, __m128 b) { return _mm_add_ps(a, b); }
+static inline __m128 sub(__m128 a, __m128 b) { return _mm_sub_ps(a, b); }
+static inline __m128 mul(__m128 a, __m128 b) { return _mm_mul_ps(a, b); }
+static inline __m128 divide(__m128 a, __m128 b) { return _mm_div_ps(a, b); }
+static inline __m128 inv_or_zero(__m128 a) {
+	//(1/0 lanes are masked off, so a zero scale gives a degenerate matrix rather than inf / NaN)
+	__m128 nonzero = _mm_cmpneq_ps(a, _mm_setzero_ps());
+	return _mm_and_ps(nonzero, _mm_div_ps(_mm_set1_ps(1.0f), a));
+}
+static inline __m128 splat(float a, __m128) { return _mm_set1_ps(a); }
+#endif
+
+//rotation matrix (column-major) of quaternion (x,y,z,w), as in glm::mat3_cast:
+template< typename V >
+static void rotation_matrix(V x, V y, V z, V w, V r[9]) {
+	V const one = splat(1.0f, x);
+	V const two = splat(2.0f, x);
+	V xx = mul(x, x), yy = mul(y, y), zz = mul(z, z);
+	V xz = mul(x, z), xy = mul(x, y), yz = mul(y, z);
+	V wx = mul(w, x), wy = mul(w, y), wz = mul(w, z);
+
+	r[0] = sub(one, mul(two, add(yy, zz)));
+	r[1] = mul(two, add(xy, wz));
+	r[2] = mul(two, sub(xz, wy));
+
+	r[3] = mul(two, sub(xy, wz));
+	r[4] = sub(one, mul(two, add(xx, zz)));
+	r[5] = mul(two, add(yz, wx));
+
+	r[6] = mul(two, add(xz, wy));
+	r[7] = mul(two, sub(yz, wx));
+	r[8] = sub(one, mul(two, add(xx, yy)));
+}
+
+/*
+	Local matrices of one (or four) transforms, computed as in
+	Transform::make_local_to_parent and Transform::make_parent_to_local:
+		q = rotation (x,y,z,w), s = scale, p = position
+*/
+template< typename V >
+static void local_matrices(V const q[4], V const s[3], V const p[3], V local_to_parent[12], V parent_to_local[12]) {
+	V rot[9];
+	rotation_matrix(q[0], q[1], q[2], q[3], rot);
+	for (uint32_t c = 0; c < 3; ++c) {
+		for (uint32_t r = 0; r < 3; ++r) {
+			local_to_parent[c * 3 + r] = mul(rot[c * 3 + r], s[c]);
+		}
+	}
+	for (uint32_t r = 0; r < 3; ++r) {
+		local_to_parent[9 + r] = p[r];
+	}
+
+	//inverse rotation is the rotation of conjugate(q) / dot(q,q), as in glm::inverse:
+	V n = add(add(mul(q[3], q[3]), mul(q[0], q[0])), add(mul(q[1], q[1]), mul(q[2], q[2])));
+	V zero = splat(0.0f, n);
+	V inv_rot[9];
+	rotation_matrix(divide(sub(zero, q[0]), n), divide(sub(zero, q[1]), n), divide(sub(zero, q[2]), n), divide(q[3], n), inv_rot);
+
+	V inv_scale[3] = { inv_or_zero(s[0]), inv_or_zero(s[1]), inv_or_zero(s[2]) };
+	for (uint32_t c = 0; c < 3; ++c) {
+		for (uint32_t r = 0; r < 3; ++r) {
+			parent_to_local[c * 3 + r] = mul(inv_rot[c * 3 + r], inv_scale[r]);
+		}
+	}
+	for (uint32_t r = 0; r < 3; ++r) {
+		parent_to_local[9 + r] = sub(zero, add(add(
+			mul(parent_to_local[r], p[0]),
+			mul(parent_to_local[3 + r], p[1])),
+			mul(parent_to_local[6 + r], p[2])
+		));
+	}
+}
+
+//-------------------------
+
+bool Scene::Hierarchy::current(Scene const &scene) const {
+	if (transforms.size() != scene.transforms.size()) return false;
+	for (uint32_t i = 0; i < transforms.size(); ++i) {
+		if (!scene.transforms.valid(handles[i])) return false;
+		if (transforms[i]->parent != parents[i]) return false;
+	}
+	return true;
+}
+
+void Scene::Hierarchy::build(Scene const &scene) {
+	//number transforms in iteration order:
+	std::vector< Transform const * > all;
+	all.reserve(scene.transforms.size());
+	std::unordered_map< Transform const *, uint32_t > index;
+	index.reserve(scene.transforms.size());
+	for (Transform const &transform : scene.transforms) {
+		index.emplace(&transform, uint32_t(all.size()));
+		all.emplace_back(&transform);
+	}
+
+	//find each transform's children (as ranges of 'children', in iteration order):
+	external = false;
+	std::vector< uint32_t > parent_of(all.size(), -1U);
+	std::vector< uint32_t > first_child(all.size() + 1, 0);
+	for (uint32_t i = 0; i < all.size(); ++i) {
+		if (!all[i]->parent) continue;
+		auto f = index.find(all[i]->parent);
+		if (f == index.end()) {
+			external = true;
+			continue;
+		}
+		parent_of[i] = f->second;
+		first_child[f->second + 1] += 1;
+	}
+	for (uint32_t i = 0; i < all.size(); ++i) {
+		first_child[i + 1] += first_child[i];
+	}
+	std::vector< uint32_t > children(first_child.back());
+	{
+		std::vector< uint32_t > next(first_child.begin(), first_child.end() - 1);
+		for (uint32_t i = 0; i < all.size(); ++i) {
+			if (parent_of[i] != -1U) children[next[parent_of[i]]++] = i;
+		}
+	}
+
+	//walk each root's subtree in pre-order:
+	transforms.clear();
+	handles.clear();
+	parents.clear();
+	parent_index.clear();
+	roots.clear();
+	std::vector< uint32_t > flat_index(all.size(), -1U);
+	std::vector< uint32_t > stack;
+	for (uint32_t root = 0; root < all.size(); ++root) {
+		if (parent_of[root] != -1U) continue;
+		roots.emplace_back(uint32_t(transforms.size()));
+		stack.emplace_back(root);
+		while (!stack.empty()) {
+			uint32_t i = stack.back();
+			stack.pop_back();
+			flat_index[i] = uint32_t(transforms.size());
+			transforms.emplace_back(all[i]);
+			handles.emplace_back(scene.transforms.handle(all[i]));
+			parents.emplace_back(all[i]->parent);
+			parent_index.emplace_back(parent_of[i] == -1U ? -1U : flat_index[parent_of[i]]);
+			//(pushed in reverse, so children are visited in iteration order)
+			for (uint32_t c = first_child[i + 1]; c > first_child[i]; --c) {
+				stack.emplace_back(children[c - 1]);
+			}
+		}
+	}
+	//transforms in a parent cycle are never reached from a root:
+	if (transforms.size() != all.size()) {
+		transforms.clear();
+		throw std::runtime_error("Scene transform hierarchy contains a parent cycle.");
+	}
+
+	size_t count = transforms.size();
+	for (auto &v : position) v.resize(count);
+	for (auto &v : rotation) v.resize(count);
+	for (auto &v : scale) v.resize(count);
+	changed.resize(count);
+	for (auto &v : local_to_parent) v.resize(count);
+	for (auto &v : parent_to_local) v.resize(count);
+}
+
+void Scene::Hierarchy::update(uint32_t begin, uint32_t end) {
+	assert(begin <= end && end <= transforms.size());
+
+	//gather (noting which transforms differ from their caches):
+	for (uint32_t i = begin; i < end; ++i) {
+		Transform const &t = *transforms[i];
+		Transform::WorldCache const &cache = t.world_cache;
+		for (uint32_t a = 0; a < 3; ++a) {
+			position[a][i] = t.position[a];
+			scale[a][i] = t.scale[a];
+		}
+		rotation[0][i] = t.rotation.x;
+		rotation[1][i] = t.rotation.y;
+		rotation[2][i] = t.rotation.z;
+		rotation[3][i] = t.rotation.w;
+		changed[i] = !(cache.version != 0
+		 && cache.position == t.position && cache.rotation == t.rotation && cache.scale == t.scale
+		 && cache.parent == t.parent);
+	}
+
+	//local matrices of changed transforms, four transforms at a time where possible:
+	{
+		uint32_t i = begin;
+		#ifdef SCENE_HIERARCHY_SSE
+		for (; i + 4 <= end; i += 4) {
+			if (!(changed[i] | changed[i + 1] | changed[i + 2] | changed[i + 3])) continue;
+			__m128 q[4], s[3], p[3], l2p[12], p2l[12];
+			for (uint32_t a = 0; a < 4; ++a) q[a] = _mm_loadu_ps(&rotation[a][i]);
+			for (uint32_t a = 0; a < 3; ++a) s[a] = _mm_loadu_ps(&scale[a][i]);
+			for (uint32_t a = 0; a < 3; ++a) p[a] = _mm_loadu_ps(&position[a][i]);
+			local_matrices(q, s, p, l2p, p2l);
+			for (uint32_t e = 0; e < 12; ++e) {
+				_mm_storeu_ps(&local_to_parent[e][i], l2p[e]);
+				_mm_storeu_ps(&parent_to_local[e][i], p2l[e]);
+			}
+		}
+		#endif
+		for (; i < end; ++i) {
+			if (!changed[i]) continue;
+			float q[4], s[3], p[3], l2p[12], p2l[12];
+			for (uint32_t a = 0; a < 4; ++a) q[a] = rotation[a][i];
+			for (uint32_t a = 0; a < 3; ++a) s[a] = scale[a][i];
+			for (uint32_t a = 0; a < 3; ++a) p[a] = position[a][i];
+			local_matrices(q, s, p, l2p, p2l);
+			for (uint32_t e = 0; e < 12; ++e) {
+				local_to_parent[e][i] = l2p[e];
+				parent_to_local[e][i] = p2l[e];
+			}
+		}
+	}
+
+	//compose with parents (which come earlier in the same range) and store in the world caches:
+	for (uint32_t i = begin; i < end; ++i) {
+		Transform const &t = *transforms[i];
+		Transform::WorldCache &cache = t.world_cache;
+
+		Transform::WorldCache const *parent_cache = nullptr;
+		if (parent_index[i] != -1U) {
+			parent_cache = &transforms[parent_index[i]]->world_cache;
+		} else if (t.parent) {
+			//parent from outside the scene; its world matrices come from its own (lazy) cache:
+			t.parent->update_world_cache();
+			parent_cache = &t.parent->world_cache;
+		}
+		uint32_t parent_version = (parent_cache ? parent_cache->version : 0);
+
+		//(as in Transform::update_world_cache)
+		if (!changed[i] && cache.parent_version == parent_version) continue; //nothing changed since the last rebuild
+
+		glm::mat4x3 l2p, p2l;
+		if (changed[i]) {
+			for (uint32_t e = 0; e < 12; ++e) {
+				l2p[e / 3][e % 3] = local_to_parent[e][i];
+				p2l[e / 3][e % 3] = parent_to_local[e][i];
+			}
+		} else {
+			//only the parent changed, so the cached values are the transform's own:
+			l2p = t.make_local_to_parent();
+			p2l = t.make_parent_to_local();
+		}
+
+		glm::mat4x3 local_to_world, world_to_local;
+		if (!parent_cache) {
+			local_to_world = l2p;
+			world_to_local = p2l;
+		} else {
+			//note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+			local_to_world = parent_cache->local_to_world * glm::mat4(l2p);
+			world_to_local = p2l * glm::mat4(parent_cache->world_to_local);
+		}
+
+		cache.position = t.position;
+		cache.rotation = t.rotation;
+		cache.scale = t.scale;
+		cache.parent = t.parent;
+		cache.parent_version = parent_version;
+		if (cache.version != 0 && cache.local_to_world == local_to_world && cache.world_to_local == world_to_local) {
+			continue; //same matrices, so nothing that depends on them needs rebuilding
+		}
+		cache.local_to_world = local_to_world;
+		cache.world_to_local = world_to_local;
+		cache.version += 1;
+		if (cache.version == 0) cache.version = 1; //(0 is reserved for "never built")
+	}
+}
+
+//-------------------------
+
+void Scene::update_world_matrices(uint32_t threads) {
+	//splitting only pays for itself with plenty of transforms per thread:
+	static constexpr uint32_t MinPerThread = 1024;
+
+	if (!flat_hierarchy.current(*this)) flat_hierarchy.build(*this);
+	uint32_t count = uint32_t(flat_hierarchy.transforms.size());
+
+	if (threads > count / MinPerThread) threads = count / MinPerThread;
+	if (threads <= 1 || flat_hierarchy.external) {
+		flat_hierarchy.update(0, count);
+		return;
+	}
+
+	//split into ranges of whole root subtrees, of roughly count / threads transforms each:
+	std::vector< uint32_t > splits;
+	splits.emplace_back(0);
+	for (uint32_t r = 1; r < flat_hierarchy.roots.size(); ++r) {
+		uint32_t target = uint32_t(uint64_t(count) * splits.size() / threads);
+		if (flat_hierarchy.roots[r] >= target && splits.size() < threads) splits.emplace_back(flat_hierarchy.roots[r]);
+	}
+	splits.emplace_back(count);
+
+	std::vector< std::thread > workers;
+	for (uint32_t s = 1; s + 1 < splits.size(); ++s) {
+		workers.emplace_back([this, begin = splits[s], end = splits[s + 1]]() {
+			flat_hierarchy.update(begin, end);
+		});
+	}
+	flat_hierarchy.update(splits[0], splits[1]);
+	for (auto &worker : workers) {
+		worker.join();
+	}
+}
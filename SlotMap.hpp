@@ -0,0 +1,226 @@
+#pragma once
+
+/*
+ * A SlotMap holds objects in fixed-size blocks of contiguous slots, for the
+ *  objects of a Scene (transforms, drawables, cameras, lights).
+ *
+ * Objects never move once emplaced: blocks are never reallocated, so plain
+ *  pointers (e.g., Drawable::transform, Transform::parent) stay valid until the
+ *  object is erased or the map is cleared. That keeps existing Transform * code
+ *  working unchanged.
+ *
+ * For references that need to notice when an object goes away, handle() gives a
+ *  generational Handle: get() resolves it in O(1), and returns nullptr once its
+ *  object has been erased (even if the slot was since reused).
+ *
+ * Iteration is a linear scan over 'dense', a packed array of the slots that
+ *  hold objects, so it never visits an empty slot. Objects are in the order
+ *  they were emplaced, except that erase() moves the last object into the
+ *  erased one's place in that order (and frees its slot for the next
+ *  emplace_back() to reuse).
+ *
+ * Finding the slot of a pointer (for handle() and erase()) is O(1): each
+ *  BlockSize * sizeof(T)-byte range of addresses maps to the (at most two)
+ *  blocks that overlap it.
+ *
+ */
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+template< typename T, uint32_t BlockSize = 64 >
+struct SlotMap {
+	struct Handle {
+		uint32_t slot = -1U;
+		uint32_t generation = 0;
+		bool operator==(Handle const &other) const { return slot == other.slot && generation == other.generation; }
+		bool operator!=(Handle const &other) const { return !(*this == other); }
+	};
+
+	SlotMap() = default;
+	~SlotMap() { clear(); }
+
+	//copying compacts: the copy has other's objects in order, with no empty slots
+	// (handles into 'other' don't refer to the copy)
+	SlotMap(SlotMap const &other) { *this = other; }
+	SlotMap &operator=(SlotMap const &other) {
+		if (this == &other) return *this;
+		clear();
+		for (T const &value : other) emplace_back(value);
+		return *this;
+	}
+
+	//----- std::list-style interface -----
+
+	//construct an object in a free slot (the most recently emplaced object is back()):
+	template< typename... Args >
+	T &emplace_back(Args&&... args) {
+		uint32_t slot = (free_slots.empty() ? used : free_slots.back());
+		if (slot / BlockSize >= blocks.size()) add_block();
+		if (slot >= generations.size()) {
+			generations.emplace_back(0);
+			dense_index.emplace_back(-1U);
+		}
+		dense.reserve(dense.size() + 1);
+		//(the slot is only taken once construction succeeds)
+		T *value = new (slot_storage(slot)) T(std::forward< Args >(args)...);
+		if (slot == used) used += 1;
+		else free_slots.pop_back();
+		dense_index[slot] = uint32_t(dense.size());
+		dense.emplace_back(slot);
+		return *value;
+	}
+
+	T &back() { assert(!dense.empty()); return *at(dense.back()); }
+	T const &back() const { assert(!dense.empty()); return *at(dense.back()); }
+	T &front() { assert(!dense.empty()); return *at(dense.front()); }
+	T const &front() const { assert(!dense.empty()); return *at(dense.front()); }
+
+	size_t size() const { return dense.size(); }
+	bool empty() const { return dense.empty(); }
+
+	//destroy every object (handles to them all stop resolving; blocks are kept for reuse):
+	void clear() {
+		for (uint32_t slot : dense) {
+			at(slot)->~T();
+			dense_index[slot] = -1U;
+		}
+		for (uint32_t slot = 0; slot < used; ++slot) {
+			generations[slot] += 1;
+		}
+		dense.clear();
+		free_slots.clear();
+		used = 0;
+	}
+
+	//----- handles -----
+
+	//handle of an object in this map (or an invalid handle, if it isn't in this map):
+	Handle handle(T const *value) const {
+		uint32_t slot = slot_of(value);
+		if (slot >= used || dense_index[slot] == -1U) return Handle();
+		return Handle{slot, generations[slot]};
+	}
+
+	//the object a handle refers to, or nullptr if it has been erased:
+	T *get(Handle const &handle) {
+		if (!valid(handle)) return nullptr;
+		return at(handle.slot);
+	}
+	T const *get(Handle const &handle) const {
+		if (!valid(handle)) return nullptr;
+		return at(handle.slot);
+	}
+	bool valid(Handle const &handle) const {
+		return handle.slot < used && dense_index[handle.slot] != -1U && generations[handle.slot] == handle.generation;
+	}
+
+	//destroy one object (does nothing for a stale handle):
+	// the last object in iteration order takes its place in that order
+	void erase(Handle const &handle) {
+		if (!valid(handle)) return;
+		uint32_t slot = handle.slot;
+		at(slot)->~T();
+
+		uint32_t moved = dense.back();
+		dense[dense_index[slot]] = moved;
+		dense_index[moved] = dense_index[slot];
+		dense.pop_back();
+		dense_index[slot] = -1U;
+
+		generations[slot] += 1;
+		free_slots.emplace_back(slot);
+	}
+	void erase(T const *value) { erase(handle(value)); }
+
+	//----- iteration (over live objects, in 'dense' order) -----
+	template< typename Map, typename Value >
+	struct Iterator {
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = T;
+		using difference_type = std::ptrdiff_t;
+		using pointer = Value *;
+		using reference = Value &;
+
+		Map *map = nullptr;
+		uint32_t index = 0; //into map->dense
+
+		Iterator() = default;
+		Iterator(Map *map_, uint32_t index_) : map(map_), index(index_) { }
+
+		reference operator*() const { return *map->at(map->dense[index]); }
+		pointer operator->() const { return map->at(map->dense[index]); }
+		Iterator &operator++() { ++index; return *this; }
+		Iterator operator++(int) { Iterator ret = *this; ++*this; return ret; }
+		bool operator==(Iterator const &other) const { return index == other.index; }
+		bool operator!=(Iterator const &other) const { return index != other.index; }
+	};
+	using iterator = Iterator< SlotMap, T >;
+	using const_iterator = Iterator< SlotMap const, T const >;
+
+	iterator begin() { return iterator(this, 0); }
+	iterator end() { return iterator(this, uint32_t(dense.size())); }
+	const_iterator begin() const { return const_iterator(this, 0); }
+	const_iterator end() const { return const_iterator(this, uint32_t(dense.size())); }
+
+	//----- internals -----
+	struct Block {
+		alignas(T) unsigned char storage[sizeof(T) * BlockSize];
+	};
+	std::vector< std::unique_ptr< Block > > blocks; //never reallocated, so objects don't move
+
+	static constexpr size_t BlockBytes = sizeof(T) * BlockSize;
+	//blocks overlapping each BlockBytes-sized range of addresses (key: address / BlockBytes; -1U if none):
+	// (a block overlaps at most two such ranges, and a range at most two blocks, since blocks don't overlap)
+	std::unordered_map< uintptr_t, std::array< uint32_t, 2 > > block_ranges;
+
+	std::vector< uint32_t > dense; //slots holding objects, in iteration order
+	std::vector< uint32_t > dense_index; //per slot, its index in 'dense' (-1U if it holds no object)
+	std::vector< uint32_t > generations; //per slot, bumped whenever its object is destroyed
+	std::vector< uint32_t > free_slots; //freed slots below 'used', reused last-freed first
+	uint32_t used = 0; //slots at or past this have never held an object since the last clear()
+
+	void add_block() {
+		uint32_t b = uint32_t(blocks.size());
+		blocks.emplace_back(new Block);
+		uintptr_t storage = reinterpret_cast< uintptr_t >(blocks.back()->storage);
+		for (uintptr_t key : {storage / BlockBytes, (storage + BlockBytes - 1) / BlockBytes}) {
+			auto &overlapping = block_ranges.emplace(key, std::array< uint32_t, 2 >{-1U, -1U}).first->second;
+			if (overlapping[0] == b) continue; //(both ends in the same range)
+			if (overlapping[0] == -1U) overlapping[0] = b;
+			else overlapping[1] = b;
+		}
+	}
+
+	void *slot_storage(uint32_t slot) {
+		return blocks[slot / BlockSize]->storage + sizeof(T) * (slot % BlockSize);
+	}
+	T *at(uint32_t slot) {
+		return std::launder(reinterpret_cast< T * >(slot_storage(slot)));
+	}
+	T const *at(uint32_t slot) const {
+		return const_cast< SlotMap * >(this)->at(slot);
+	}
+	//slot at 'value', or -1U if it isn't in one of this map's blocks:
+	uint32_t slot_of(T const *value) const {
+		uintptr_t address = reinterpret_cast< uintptr_t >(value);
+		auto f = block_ranges.find(address / BlockBytes);
+		if (f == block_ranges.end()) return -1U;
+		for (uint32_t b : f->second) {
+			if (b == -1U) continue;
+			uintptr_t storage = reinterpret_cast< uintptr_t >(blocks[b]->storage);
+			if (address >= storage && address < storage + BlockBytes) {
+				return b * BlockSize + uint32_t((address - storage) / sizeof(T));
+			}
+		}
+		return -1U;
+	}
+};
@@ -5,6 +5,7 @@
 #include <SDL.h>
 
 #include <list>
+#include <chrono>
 #include <cassert>
 #include <exception>
 #include <iostream>
@@ -20,6 +21,16 @@ namespace {
 	//The audio device:
 	SDL_AudioDeviceID device = 0;
 
+	//samples the device buffers ahead of what is being heard (set when the device is opened):
+	uint32_t device_buffer_samples = 0;
+
+	int64_t clock_now() {
+		return std::chrono::steady_clock::now().time_since_epoch().count();
+	}
+	double clock_seconds(int64_t ticks) {
+		return std::chrono::duration< double >(std::chrono::steady_clock::duration(ticks)).count();
+	}
+
 	//list of all currently playing samples:
 	std::list< std::shared_ptr< Sound::PlayingSample > > playing_samples;
 
@@ -74,6 +85,7 @@ void Sound::init() {
 		std::cerr << "Failed to open audio device:\n" << SDL_GetError() << std::endl;
 		std::cerr << "  (Will continue without audio.)\n" << std::endl;
 	} else {
+		device_buffer_samples = have.samples;
 		//start audio playback:
 		SDL_PauseAudioDevice(device, 0);
 		std::cout << "Audio output initialized." << std::endl;
@@ -87,6 +99,7 @@ void Sound::shutdown() {
 		SDL_PauseAudioDevice(device, 1);
 		SDL_CloseAudioDevice(device);
 		device = 0;
+		device_buffer_samples = 0;
 	}
 }
 
@@ -142,6 +155,10 @@ void Sound::stop_all_samples() {
 	unlock();
 }
 
+float Sound::output_latency() {
+	return float(device_buffer_samples) / float(AUDIO_RATE);
+}
+
 void Sound::set_volume(float new_volume, float ramp) {
 	lock();
 	volume.set(new_volume, ramp);
@@ -150,6 +167,46 @@ void Sound::set_volume(float new_volume, float ramp) {
 
 //------------------
 
+Sound::PlayingSample::PlayingSample(Sample const &sample_, float volume_, float pan_, bool loop_)
+	: data(sample_.data), loop(loop_), volume(volume_), pan(pan_) {
+	publish_clock(-double(Sound::output_latency()), device ? ClockMixing : ClockFree);
+}
+
+Sound::PlayingSample::PlayingSample(Sample const &sample_, float volume_, glm::vec3 const &position_, float half_volume_radius_, bool loop_)
+	: data(sample_.data), loop(loop_), volume(volume_), position(position_), half_volume_radius(half_volume_radius_) {
+	publish_clock(-double(Sound::output_latency()), device ? ClockMixing : ClockFree);
+}
+
+void Sound::PlayingSample::publish_clock(double position_, ClockMode mode) {
+	clock_sequence.fetch_add(1, std::memory_order_acq_rel);
+	clock_position.store(position_, std::memory_order_relaxed);
+	clock_time.store(clock_now(), std::memory_order_relaxed);
+	clock_mode.store(mode, std::memory_order_relaxed);
+	clock_sequence.fetch_add(1, std::memory_order_release);
+}
+
+double Sound::PlayingSample::get_time() const {
+	double at;
+	int64_t at_time;
+	uint32_t mode;
+	uint32_t sequence;
+	do {
+		sequence = clock_sequence.load(std::memory_order_acquire);
+		at = clock_position.load(std::memory_order_relaxed);
+		at_time = clock_time.load(std::memory_order_relaxed);
+		mode = clock_mode.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+	} while ((sequence & 1) || sequence != clock_sequence.load(std::memory_order_relaxed));
+
+	if (mode == ClockPaused) return at;
+	double since = std::max(0.0, clock_seconds(clock_now() - at_time));
+	if (mode == ClockMixing) {
+		//the mixer only ever gets one buffer ahead; if it's late, so is the audio:
+		since = std::min(since, double(MIX_SAMPLES) / double(AUDIO_RATE));
+	}
+	return at + since;
+}
+
 void Sound::PlayingSample::set_volume(float new_volume, float ramp) {
 	Sound::lock();
 	if (!stopping) {
@@ -195,6 +252,9 @@ void Sound::PlayingSample::stop(float ramp) {
 // 			so that we can make a ramp for stopping sound over time as well
 void Sound::PlayingSample::pause(bool stop) {
 	Sound::lock();
+	if (stop != paused) {
+		publish_clock(get_time(), stop ? ClockPaused : (device && !stopped ? ClockMixing : ClockFree));
+	}
 	paused = stop;
 	if (stop) {
 		volume_stored = volume.value;
@@ -412,6 +472,9 @@ void mix_audio(void *, Uint8 *buffer_, int len) {
 
 		assert(playing_sample.i < playing_sample.data.size());
 
+		//what's mixed now will be heard once the device has played out what it already has:
+		playing_sample.publish_clock(double(playing_sample.played) / double(AUDIO_RATE) - double(Sound::output_latency()), Sound::PlayingSample::ClockMixing);
+
 		for (uint32_t i = 0; i < MIX_SAMPLES; ++i) {
 			//mix one sample based on current pan values:
 			buffer[i].l += pan.l * playing_sample.data[playing_sample.i];
@@ -419,6 +482,7 @@ void mix_audio(void *, Uint8 *buffer_, int len) {
 
 			//update position in sample:
 			playing_sample.i += 1;
+			playing_sample.played += 1;
 			if (playing_sample.i == playing_sample.data.size()) {
 				if (playing_sample.loop) {
 					playing_sample.i = 0;
@@ -435,6 +499,8 @@ void mix_audio(void *, Uint8 *buffer_, int len) {
 		if (playing_sample.i >= playing_sample.data.size()
 		 || (playing_sample.stopping && playing_sample.volume.value == 0.0f)) { //sample has finished
 		 	playing_sample.stopped = true;
+			//nothing more to mix, so let the clock run on from here:
+			playing_sample.publish_clock(playing_sample.get_time(), Sound::PlayingSample::ClockFree);
 			//erase from list:
 			auto old = si;
 			++si;
@@ -2,6 +2,7 @@
 
 #include <glm/glm.hpp>
 
+#include <atomic>
 #include <memory>
 #include <vector>
 #include <string>
@@ -64,6 +65,12 @@ struct PlayingSample {
 	void stop(float ramp = 1.0f / 60.0f);
 	void pause(bool stop);
 
+	//playback position (in seconds) of the sample as currently heard through the output device:
+	// follows the samples consumed by the mixer, interpolated between mixer callbacks and delayed by output_latency();
+	// holds still while paused, and keeps running at wall-clock rate once the sample finishes (or if there is no audio device)
+	// lock-free, so it is cheap to call from the game thread at any time
+	double get_time() const;
+
 	//internals:
 	//NOTE: PlayingSample is used in a separate thread; so setting these values directly
 	// may result in bad results. Instead, use the functions above, which perform locking!
@@ -74,6 +81,19 @@ struct PlayingSample {
 	bool stopped = false; //was playback stopped (either by running out of sample, or by stop())?
 	bool paused = false;
 	float volume_stored = 1.0f;
+	uint64_t played = 0; //samples consumed by the mixer, not counting loops back to the start
+
+	//playback clock, published by the mixer for get_time() (a seqlock: writers hold Sound::lock()):
+	enum ClockMode : uint32_t {
+		ClockMixing, //advances between mixer callbacks, up to one mix buffer
+		ClockPaused, //holds still
+		ClockFree, //advances with wall-clock time
+	};
+	void publish_clock(double position, ClockMode mode);
+	std::atomic< uint32_t > clock_sequence{0}; //odd while being written
+	std::atomic< double > clock_position{0.0}; //heard position at clock_time
+	std::atomic< int64_t > clock_time{0}; //std::chrono::steady_clock ticks
+	std::atomic< uint32_t > clock_mode{ClockFree};
 
 	Ramp< float > volume = Ramp< float >(1.0f);
 
@@ -84,10 +104,8 @@ struct PlayingSample {
 	Ramp< glm::vec3 > position = Ramp< glm::vec3 >(std::numeric_limits< float >::quiet_NaN());
 	Ramp< float > half_volume_radius = std::numeric_limits< float >::quiet_NaN();
 
-	PlayingSample(Sample const &sample_, float volume_, float pan_, bool loop_)
-		: data(sample_.data), loop(loop_), volume(volume_), pan(pan_) { }
-	PlayingSample(Sample const &sample_, float volume_, glm::vec3 const &position_, float half_volume_radius_, bool loop_)
-		: data(sample_.data), loop(loop_), volume(volume_), position(position_), half_volume_radius(half_volume_radius_) { }
+	PlayingSample(Sample const &sample_, float volume_, float pan_, bool loop_);
+	PlayingSample(Sample const &sample_, float volume_, glm::vec3 const &position_, float half_volume_radius_, bool loop_);
 };
 
 // ------- global functions -------
@@ -139,6 +157,10 @@ extern struct Listener listener;
 //"panic button" to shut off all currently playing sounds:
 void stop_all_samples();
 
+//estimated time (in seconds) between the mixer consuming a sample and it being heard:
+// (one mix buffer; zero if there is no audio device)
+float output_latency();
+
 //set global volume:
 void set_volume(float new_volume, float ramp = 1.0f / 60.0f);
 extern Ramp< float > volume;
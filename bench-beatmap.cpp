@@ -0,0 +1,68 @@
+#include "Beatmap.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//bench-beatmap times the text chart parser on a synthetic chart:
+// usage: ./bench-beatmap [notes (default 100000)] [iterations (default 20)]
+int main(int argc, char **argv) {
+	uint32_t note_count = 100000;
+	uint32_t iterations = 20;
+	if (argc > 1) note_count = uint32_t(std::max(1, std::atoi(argv[1])));
+	if (argc > 2) iterations = uint32_t(std::max(1, std::atoi(argv[2])));
+
+	//build a chart in the same shape as the hand-written ones (mostly singles, some holds and bursts):
+	std::string text;
+	{
+		std::mt19937 mt(0x15466);
+		std::uniform_real_distribution< float > coord(-1.0f, 1.0f);
+		static const char *dirs[] = { "up", "down", "left", "right" };
+		float time = 2.0f;
+		for (uint32_t i = 0; i < note_count; ++i) {
+			uint32_t kind = mt() % 10;
+			std::string dir = dirs[mt() % 4];
+			std::string skin = std::to_string(mt() % 10);
+			if (kind < 7) {
+				text += "single " + skin + " " + dir + " " + std::to_string(coord(mt)) + " @ " + std::to_string(time) + "\n";
+				time += 0.25f;
+			} else if (kind < 9) {
+				text += "hold " + skin + " " + dir + " " + std::to_string(coord(mt)) + " " + std::to_string(coord(mt)) + " @ " + std::to_string(time) + " " + std::to_string(time + 0.5f) + "\n";
+				time += 0.75f;
+			} else {
+				text += "burst " + skin + " " + dir + " " + std::to_string(coord(mt)) + " @ " + std::to_string(time) + "\n";
+				time += 0.25f;
+			}
+		}
+	}
+
+	std::vector< double > times;
+	size_t parsed_notes = 0;
+	try {
+		for (uint32_t iter = 0; iter < iterations; ++iter) {
+			auto before = std::chrono::high_resolution_clock::now();
+			Beatmap beatmap;
+			beatmap.parse_text(text, "synthetic");
+			auto after = std::chrono::high_resolution_clock::now();
+			times.emplace_back(std::chrono::duration< double >(after - before).count());
+			parsed_notes = beatmap.notes.size();
+		}
+	} catch (std::exception const &e) {
+		std::cerr << "Failed to parse synthetic beatmap:\n" << e.what() << std::endl;
+		return 1;
+	}
+
+	std::sort(times.begin(), times.end());
+	double best = times.front();
+	double median = times[times.size() / 2];
+	std::cout << "Parsed " << parsed_notes << " notes (" << text.size() / 1024 << " KiB) " << iterations << " times.\n";
+	std::cout << "  best:   " << best * 1000.0 << " ms (" << parsed_notes / best / 1.0e6 << " M notes/s, " << text.size() / best / (1024.0 * 1024.0) << " MiB/s)\n";
+	std::cout << "  median: " << median * 1000.0 << " ms" << std::endl;
+
+	return 0;
+}
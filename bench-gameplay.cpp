@@ -0,0 +1,260 @@
+#include "Gameplay.hpp"
+#include "Beatmap.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//bench-gameplay plays a chart with a perfect autoplayer, faster than realtime, and times every frame
+// of gameplay work (note updates, ray traces against the notes, and hit judging):
+// usage: ./bench-gameplay [notes per second (default 20)] [seconds (default 120)] [--beatmap <chart>] [--fps <frames per second (default 144)>]
+//                         [--health] [--max-p99 <us>] [--min-realtime <x>]
+//  (with --beatmap the chart is loaded instead of generated, and the first two arguments are ignored)
+// the chart is played without health (as the tutorial is), so every frame of it is timed however many notes are missed;
+//  with --health, running out of health fails the song and ends the run early, as in the game
+// misses, bad hits, and wrong-gun hits are reported along with the other judgements (dense charts get some)
+// once per second of song (outside the timed part of the frame), a second window seeks straight to the current step
+//  and must hold the same live notes as gameplay's, which advanced there from the start
+// exits with an error if a seek doesn't match, the p99 frame time is over --max-p99, or the run is slower than --min-realtime times realtime
+
+//the camera sits back from the border so the whole border is within aiming range:
+static glm::vec3 const CameraPosition = glm::vec3(0.0f, 0.0f, 4.0f);
+
+//synthetic chart: mostly singles, some bursts, and holds with nothing else during them
+// (one note in ten is a hold lasting four note spacings, so the spacing is 1 / (1.4 * notes_per_second))
+static Beatmap make_chart(float notes_per_second, float seconds) {
+	Beatmap beatmap;
+	std::mt19937 mt(0x15466);
+	std::uniform_real_distribution< float > coord(-0.9f, 0.9f);
+
+	float spacing = 1.0f / (1.4f * notes_per_second);
+	float hold = 4.0f * spacing;
+	for (float time = 2.0f; time < seconds; ) {
+		uint32_t kind = mt() % 10;
+		Beatmap::Note note;
+		note.skin = uint8_t(mt() % 10);
+		note.dir = uint8_t(mt() % 4);
+		note.point_begin = uint32_t(beatmap.points.size());
+		if (kind < 7) {
+			note.type = NoteType::SINGLE;
+			beatmap.points.emplace_back(Beatmap::Point{coord(mt), time});
+			time += spacing;
+		} else if (kind < 9) {
+			note.type = NoteType::BURST;
+			beatmap.points.emplace_back(Beatmap::Point{coord(mt), time});
+			time += spacing;
+		} else {
+			note.type = NoteType::HOLD;
+			beatmap.points.emplace_back(Beatmap::Point{coord(mt), time});
+			beatmap.points.emplace_back(Beatmap::Point{coord(mt), time + 0.5f * hold});
+			beatmap.points.emplace_back(Beatmap::Point{coord(mt), time + hold});
+			time += hold + spacing;
+		}
+		note.point_end = uint32_t(beatmap.points.size());
+		beatmap.notes.emplace_back(note);
+	}
+	return beatmap;
+}
+
+//plays every note as it reaches the border, with the right gun, aiming exactly at the center of its box:
+// (a note that arrives while a hold is held is skipped, since clicking during a hold doesn't count)
+// holds are followed while held, but the "holding" judgement is the game's own test of how far along
+// the box the ray enters, so holds still get "dropped" judgements between their begin and end
+struct Autoplayer {
+	Gameplay &gameplay;
+	uint32_t next = 0; //next note to play
+	int held = -1; //hold note being held
+	uint32_t skipped = 0;
+
+	explicit Autoplayer(Gameplay &gameplay_) : gameplay(gameplay_) { }
+
+	//turn the camera so the crosshair ray passes through the center of note i's box at song time t:
+	// (the box trace_ray tests, i.e. that of the note's first segment, where the step at t has it)
+	void aim_at(uint32_t i, float t) {
+		gameplay.advance(t);
+		glm::vec3 at = gameplay.segment_position_at(i, gameplay.notes.segment_begin[i], gameplay.step_music_time());
+
+		//the crosshair ray is rotation * (0,0,-1), i.e. (-cos(pitch) sin(yaw), sin(pitch), -cos(pitch) cos(yaw)):
+		glm::vec3 dir = glm::normalize(at - gameplay.camera_position);
+		float pitch = std::asin(dir.y);
+		float yaw = std::atan2(-dir.x, -dir.z);
+		float azimuth = yaw / (1280.0f / 720.0f);
+		float elevation = 0.5f * 3.1415926f - pitch;
+		gameplay.aim(glm::vec2(gameplay.cam.azimuth - azimuth, gameplay.cam.elevation - elevation), t);
+	}
+
+	void release_hold(float t) {
+		aim_at(held, t);
+		gameplay.release(t);
+		held = -1;
+	}
+
+	//play everything that happens in [begin, end):
+	void frame(float end) {
+		NoteStore const &notes = gameplay.notes;
+		while (next < notes.size() && notes.hit_begin[next] < end) {
+			uint32_t i = next++;
+			float t = notes.hit_begin[i];
+			if (held != -1 && notes.hit_end[held] <= t) release_hold(notes.hit_end[held]);
+			if (held != -1) {
+				skipped += 1;
+				continue;
+			}
+
+			int gun = (notes.type[i] == NoteType::SINGLE ? 0 : notes.type[i] == NoteType::BURST ? 1 : 2);
+			if (gameplay.gun_mode != gun) gameplay.change_gun(0, gun);
+
+			aim_at(i, t);
+			gameplay.press(t);
+			if (notes.type[i] == NoteType::HOLD) {
+				held = int(i);
+			} else {
+				gameplay.release(t);
+			}
+		}
+
+		if (held != -1) {
+			if (notes.hit_end[held] < end) release_hold(notes.hit_end[held]);
+			else aim_at(held, end); //(follow the hold; aiming while holding judges it)
+		}
+	}
+};
+
+//the live (not retired) notes of a window, in spawn order:
+static std::vector< uint32_t > live_notes(ActiveWindow const &window) {
+	std::vector< uint32_t > ret;
+	for (uint32_t i = 0; i < window.live_count(); ++i) {
+		uint32_t note = window.live_note(i);
+		if (!window.is_retired(note)) ret.emplace_back(note);
+	}
+	return ret;
+}
+
+int main(int argc, char **argv) {
+	float notes_per_second = 20.0f;
+	float seconds = 120.0f;
+	float fps = 144.0f;
+	std::string beatmap_path;
+	bool use_health = false;
+	double max_p99 = 0.0; //(0 = no limit)
+	double min_realtime = 0.0; //(0 = no limit)
+
+	std::vector< std::string > args;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--beatmap" && i + 1 < argc) beatmap_path = argv[++i];
+		else if (arg == "--fps" && i + 1 < argc) fps = std::max(1.0f, float(std::atof(argv[++i])));
+		else if (arg == "--health") use_health = true;
+		else if (arg == "--max-p99" && i + 1 < argc) max_p99 = std::atof(argv[++i]);
+		else if (arg == "--min-realtime" && i + 1 < argc) min_realtime = std::atof(argv[++i]);
+		else args.emplace_back(arg);
+	}
+	if (args.size() > 0) notes_per_second = std::max(0.1f, float(std::atof(args[0].c_str())));
+	if (args.size() > 1) seconds = std::max(1.0f, float(std::atof(args[1].c_str())));
+
+	Gameplay gameplay;
+	try {
+		Beatmap beatmap = (beatmap_path.empty() ? make_chart(notes_per_second, seconds) : Beatmap(beatmap_path));
+
+		NoteStore notes;
+		notes.build(beatmap, gameplay.real_song_offset);
+		for (uint32_t i = 0; i < notes.size(); ++i) {
+			//(a unit cube, like the note meshes)
+			notes.min[i] = glm::vec3(-1.0f);
+			notes.max[i] = glm::vec3(1.0f);
+		}
+		std::vector< Gameplay::Placement > placements;
+		gameplay.place_notes(beatmap, &placements);
+		gameplay.start(notes, placements, CameraPosition, !use_health);
+	} catch (std::exception const &e) {
+		std::cerr << "Failed to load beatmap:\n" << e.what() << std::endl;
+		return 1;
+	}
+	if (gameplay.notes.size() == 0) {
+		std::cerr << "Beatmap has no notes." << std::endl;
+		return 1;
+	}
+
+	Autoplayer player(gameplay);
+
+	//run frames until every note has retired:
+	float end_time = 0.0f;
+	for (float t : gameplay.notes.hit_end) end_time = std::max(end_time, t + gameplay.valid_hit_time_delta + 1.0f);
+	uint32_t frames = uint32_t(std::ceil(end_time * fps));
+
+	std::array< uint32_t, 8 > judgements = {}; //by status + 1 (status -1 is a note that retired unhit)
+	std::vector< double > frame_times;
+	frame_times.reserve(frames);
+
+	ActiveWindow seek_window;
+	seek_window.build(gameplay.note_spawn, gameplay.note_despawn);
+	uint32_t seeks = 0, seek_mismatches = 0;
+
+	auto before = std::chrono::high_resolution_clock::now();
+	for (uint32_t f = 1; f <= frames && !gameplay.failed; ++f) {
+		float music_time = f / fps;
+
+		auto frame_before = std::chrono::high_resolution_clock::now();
+		player.frame(music_time);
+		gameplay.advance(music_time);
+		auto frame_after = std::chrono::high_resolution_clock::now();
+		frame_times.emplace_back(std::chrono::duration< double >(frame_after - frame_before).count());
+
+		for (auto const &event : gameplay.events) {
+			if (event.type == Gameplay::Event::Judge) judgements[event.status + 1] += 1;
+		}
+		gameplay.events.clear();
+
+		if (f % uint32_t(std::ceil(fps)) == 0) {
+			seek_window.seek(gameplay.step_music_time());
+			seeks += 1;
+			if (live_notes(seek_window) != live_notes(gameplay.note_window)
+			 || seek_window.retired_count() != gameplay.note_window.retired_count()) {
+				if (seek_mismatches == 0) std::cerr << "Seeking to " << gameplay.step_music_time() << "s doesn't give the live notes advancing there did." << std::endl;
+				seek_mismatches += 1;
+			}
+		}
+	}
+	auto after = std::chrono::high_resolution_clock::now();
+	double total = std::chrono::duration< double >(after - before).count();
+
+	std::vector< double > sorted = frame_times;
+	std::sort(sorted.begin(), sorted.end());
+	auto percentile = [&](double p) {
+		return sorted[std::min(sorted.size() - 1, size_t(p * sorted.size()))] * 1.0e6;
+	};
+
+	std::cout << "Played " << gameplay.notes.size() << " notes (" << gameplay.notes.segment_count() << " segments) over " << gameplay.step_music_time() << "s of song";
+	if (beatmap_path.empty()) std::cout << " (synthetic, " << gameplay.notes.size() / (gameplay.notes.hit_end.back() - gameplay.notes.hit_begin.front()) << " notes/s)";
+	else std::cout << " ('" << beatmap_path << "')";
+	std::cout << " in " << frame_times.size() << " frames at " << fps << " fps.\n";
+	std::cout << "  total:  " << total * 1000.0 << " ms (" << gameplay.step_music_time() / total << "x realtime, " << gameplay.notes.size() / total / 1.0e3 << " K notes/s)\n";
+	std::cout << "  frame:  p50 " << percentile(0.5) << " us, p90 " << percentile(0.9) << " us, p99 " << percentile(0.99) << " us, p99.9 " << percentile(0.999) << " us, max " << sorted.back() * 1.0e6 << " us\n";
+	std::cout << "  judged: " << judgements[3] << " perfect, " << judgements[2] << " good, " << judgements[5] << " hold, " << judgements[6] << " holding, "
+		<< judgements[7] << " dropped, " << judgements[4] << " wrong gun, " << judgements[1] << " bad, " << judgements[0] << " missed (" << player.skipped << " skipped during holds)\n";
+	std::cout << "  result: score " << gameplay.score << ", max combo " << gameplay.max_combo << ", health " << gameplay.health << (gameplay.failed ? " (failed)" : "") << "\n";
+	std::cout << "  seek:   " << seeks - seek_mismatches << " of " << seeks << " seeks matched advancing" << std::endl;
+
+	if (seek_mismatches > 0) return 1;
+
+	//regression thresholds (timing only: judgements depend on the chart, not on how fast it was played):
+	bool slow = false;
+	if (max_p99 > 0.0 && percentile(0.99) > max_p99) {
+		std::cerr << "p99 frame time " << percentile(0.99) << " us is over the limit of " << max_p99 << " us." << std::endl;
+		slow = true;
+	}
+	if (min_realtime > 0.0 && gameplay.step_music_time() / total < min_realtime) {
+		std::cerr << "Played " << gameplay.step_music_time() / total << "x realtime, under the limit of " << min_realtime << "x." << std::endl;
+		slow = true;
+	}
+	if (slow) return 1;
+
+	return 0;
+}
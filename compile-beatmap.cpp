@@ -0,0 +1,24 @@
+#include "Beatmap.hpp"
+
+#include <iostream>
+#include <stdexcept>
+
+//compile-beatmap converts a text chart into the '.beatc' format loaded by the game:
+// (run by Maekfile.js for every chart in dist/beatmaps)
+int main(int argc, char **argv) {
+	if (argc != 3) {
+		std::cerr << "Usage:\n\t./compile-beatmap <in.txt> <out.beatc>" << std::endl;
+		return 1;
+	}
+
+	try {
+		Beatmap beatmap(argv[1]);
+		beatmap.save(argv[2]);
+		std::cout << "Compiled '" << argv[1] << "' (" << beatmap.notes.size() << " notes) to '" << argv[2] << "'." << std::endl;
+	} catch (std::exception const &e) {
+		std::cerr << "Failed to compile beatmap:\n" << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
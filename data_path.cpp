@@ -1,6 +1,10 @@
 #include "data_path.hpp"
 
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <memory>
+#include <stdexcept>
 #include <vector>
 #include <sstream>
 
@@ -12,6 +16,7 @@
 #include <io.h>
 #elif defined(__APPLE__)
 #include <mach-o/dyld.h>
+#include <sys/stat.h>
 #elif defined(__linux__)
 #include <unistd.h>
 #include <sys/stat.h>
@@ -62,7 +67,7 @@ std::string data_path(std::string const &suffix) {
 	return path + "/" + suffix;
 }
 
-/* From Rktcr; to be used eventually!
+//From Rktcr:
 static std::string make_user_dir(std::string const &app_name) {
 	std::string ret = "";
 	#if defined(_WIN32)
@@ -75,7 +80,7 @@ static std::string make_user_dir(std::string const &app_name) {
 			if (WideCharToMultiByte(CP_UTF8, 0, path, -1, temp.get(), needed, NULL, NULL) != 0) {
 				if (temp.get()[needed-1] != '\0') {
 					temp.get()[needed-1] = '\0'; //"fix it"
-					LOG_ERROR("!!!! Woah, missing '\\0' terminator in converted string: " << temp.get());
+					std::cerr << "!!!! Woah, missing '\\0' terminator in converted string: " << temp.get() << std::endl;
 				} else {
 					ret = temp.get();
 				}
@@ -84,7 +89,7 @@ static std::string make_user_dir(std::string const &app_name) {
 		CoTaskMemFree(path);
 		path = NULL;
 	} else {
-		LOG_WARNING("Unable to locate FOLDERID_Documents.");
+		std::cerr << "Unable to locate FOLDERID_Documents." << std::endl;
 		ret = ".";
 	}
 	if (ret.empty() || ret[ret.size()-1] != '/') {
@@ -108,7 +113,7 @@ static std::string make_user_dir(std::string const &app_name) {
 	#endif
 
 	//Make sure directory exists... or at least try to!
-	#ifdef WINDOWS
+	#if defined(_WIN32)
 	_mkdir(ret.c_str());
 	#elif defined(MINGW)
 	mkdir(ret.c_str());
@@ -120,7 +125,6 @@ static std::string make_user_dir(std::string const &app_name) {
 }
 
 std::string user_path(std::string const &suffix) {
-	static std::string path = make_user_dir( ... TODO ... );
+	static std::string path = make_user_dir("dungeon-beats"); //cache result of make_user_dir()
 	return path + '/' + suffix;
 }
-*/
@@ -5,3 +5,7 @@
 //construct a path based on the location of the currently-running executable:
 // (e.g. if running /home/ix/game0/game.exe will return '/home/ix/game0/' + suffix)
 std::string data_path(std::string const &suffix);
+
+//construct a path in a per-user directory (created if needed) for files the game writes, like caches:
+// (e.g. '/home/ix/.dungeon-beats/' + suffix or 'Documents/dungeon-beats/' + suffix on windows)
+std::string user_path(std::string const &suffix);
@@ -1,10 +1,103 @@
 #include "gl_compile_program.hpp"
 
+#include "data_path.hpp"
+#include "read_write_chunk.hpp"
+#include "gl_errors.hpp"
+
+#include <SDL.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
 #include <vector>
 #include <string>
 #include <stdexcept>
 #include <iostream>
 
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+//program binaries (OpenGL 4.1 or ARB_get_program_binary) aren't part of GL.hpp's 3.3 core, so they are looked up at runtime:
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+//local (to this file) program binary cache:
+namespace {
+	struct ProgramBinaryAPI {
+		ProgramBinaryAPI() {
+			GLint major = 0, minor = 0;
+			glGetIntegerv(GL_MAJOR_VERSION, &major);
+			glGetIntegerv(GL_MINOR_VERSION, &minor);
+			if (!(major > 4 || (major == 4 && minor >= 1)) && !SDL_GL_ExtensionSupported("GL_ARB_get_program_binary")) return;
+
+			GetProgramBinary = (decltype(GetProgramBinary))SDL_GL_GetProcAddress("glGetProgramBinary");
+			ProgramBinary = (decltype(ProgramBinary))SDL_GL_GetProcAddress("glProgramBinary");
+			ProgramParameteri = (decltype(ProgramParameteri))SDL_GL_GetProcAddress("glProgramParameteri");
+			if (!GetProgramBinary || !ProgramBinary || !ProgramParameteri) return;
+
+			//drivers may support the functions but no binary formats:
+			GLint formats = 0;
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+			if (formats <= 0) return;
+
+			//binaries only work with the same driver on the same hardware:
+			for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+				GLubyte const *str = glGetString(name);
+				if (str) driver += reinterpret_cast< char const * >(str);
+				driver += '\n';
+			}
+
+			supported = true;
+		}
+		bool supported = false;
+		std::string driver;
+
+		void (APIENTRY *GetProgramBinary)(GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat, void *binary) = nullptr;
+		void (APIENTRY *ProgramBinary)(GLuint program, GLenum binaryFormat, const void *binary, GLsizei length) = nullptr;
+		void (APIENTRY *ProgramParameteri)(GLuint program, GLenum pname, GLint value) = nullptr;
+	};
+
+	//(looked up on first use, when there is certainly a context)
+	ProgramBinaryAPI const &program_binary_api() {
+		static ProgramBinaryAPI api;
+		return api;
+	}
+
+	//64-bit FNV-1a, to name cache files after the sources that went into them:
+	uint64_t hash_source(std::string const &data, uint64_t hash = 0xcbf29ce484222325ULL) {
+		auto add = [&hash](uint8_t byte) {
+			hash ^= byte;
+			hash *= 0x100000001b3ULL;
+		};
+		for (char c : data) add(uint8_t(c));
+		//(the length too, so "ab"+"c" and "a"+"bc" hash differently)
+		for (uint32_t i = 0; i < 8; ++i) add(uint8_t(uint64_t(data.size()) >> (8 * i)));
+		return hash;
+	}
+
+	//startup report (see gl_compile_program_report):
+	struct {
+		uint32_t compiled = 0;
+		float compile_seconds = 0.0f;
+		uint32_t cached = 0;
+		float cached_seconds = 0.0f;
+	} stats;
+
+	//cache file names used this run (see gl_compile_program_prune_cache):
+	std::vector< std::string > used_names;
+}
+
 static GLuint gl_compile_shader(GLenum type, std::string const &source) {
 	GLuint shader = glCreateShader(type);
 	GLchar const *str = source.c_str();
@@ -27,15 +120,105 @@ static GLuint gl_compile_shader(GLenum type, std::string const &source) {
 	return shader;
 }
 
-GLuint gl_compile_program(
+//put defines after the #version line (which must come first), then reset line numbers so errors match the original source:
+static std::string with_defines(std::string const &source, std::string const &defines) {
+	if (defines.empty()) return source;
+	size_t after_version = 0;
+	if (source.compare(0, 8, "#version") == 0) {
+		after_version = source.find('\n');
+		if (after_version == std::string::npos) throw std::runtime_error("Shader source is only a #version line.");
+		after_version += 1;
+	}
+	uint32_t line = 1;
+	for (size_t i = 0; i < after_version; ++i) {
+		if (source[i] == '\n') line += 1;
+	}
+	return source.substr(0, after_version) + defines + "#line " + std::to_string(line) + "\n" + source.substr(after_version);
+}
+
+//a cached program binary is stored as chunks (see read_write_chunk.hpp):
+// 'drvr': driver string the binary was made with
+// 'bfmt': binary format (one GLenum)
+// 'bin0': the binary
+static GLuint load_program_binary(std::string const &path) {
+	ProgramBinaryAPI const &api = program_binary_api();
+
+	std::ifstream file(path, std::ios::binary);
+	if (!file) return 0; //(not cached yet)
+
+	std::vector< char > driver;
+	std::vector< GLenum > format;
+	std::vector< char > binary;
+	try {
+		read_chunk(file, "drvr", &driver);
+		read_chunk(file, "bfmt", &format);
+		read_chunk(file, "bin0", &binary);
+	} catch (std::runtime_error &e) {
+		std::cerr << "WARNING: ignoring unreadable program cache '" << path << "': " << e.what() << std::endl;
+		return 0;
+	}
+	if (std::string(driver.begin(), driver.end()) != api.driver || format.size() != 1) return 0;
+
+	GLuint program = glCreateProgram();
+	//(report and clear any earlier errors, so they aren't mistaken for the driver rejecting the binary)
+	GL_ERRORS();
+	api.ProgramBinary(program, format[0], binary.data(), GLsizei(binary.size()));
+	//(the driver may reject a binary -- e.g., after an update -- with an error and/or failed link status)
+	bool rejected = false;
+	while (glGetError() != GL_NO_ERROR) rejected = true;
+	GLint link_status = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &link_status);
+	if (rejected || link_status != GL_TRUE) {
+		glDeleteProgram(program);
+		return 0;
+	}
+	return program;
+}
+
+static void save_program_binary(std::string const &path, GLuint program) {
+	ProgramBinaryAPI const &api = program_binary_api();
+
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) return;
+
+	std::vector< char > binary(length);
+	std::vector< GLenum > format(1, 0);
+	GLsizei got = 0;
+	api.GetProgramBinary(program, length, &got, &format[0], binary.data());
+	if (got <= 0) return;
+	binary.resize(got);
+
+	//write to a temporary file and rename, so an interrupted write never leaves a partial cache entry:
+	std::string temp = path + ".tmp";
+	{
+		std::ofstream file(temp, std::ios::binary);
+		write_chunk("drvr", std::vector< char >(api.driver.begin(), api.driver.end()), &file);
+		write_chunk("bfmt", format, &file);
+		write_chunk("bin0", binary, &file);
+		if (!file) {
+			std::cerr << "WARNING: failed to write program cache '" << temp << "'." << std::endl;
+			return;
+		}
+	}
+	std::remove(path.c_str()); //(rename won't replace an existing file on windows)
+	if (std::rename(temp.c_str(), path.c_str()) != 0) {
+		std::cerr << "WARNING: failed to write program cache '" << path << "'." << std::endl;
+	}
+}
+
+static GLuint compile_and_link(
 	std::string const &vertex_shader_source,
-	std::string const &fragment_shader_source
+	std::string const &fragment_shader_source,
+	std::string const &defines,
+	bool retrievable
 	) {
 
-	GLuint vertex_shader = gl_compile_shader(GL_VERTEX_SHADER, vertex_shader_source);
-	GLuint fragment_shader = gl_compile_shader(GL_FRAGMENT_SHADER, fragment_shader_source);
+	GLuint vertex_shader = gl_compile_shader(GL_VERTEX_SHADER, with_defines(vertex_shader_source, defines));
+	GLuint fragment_shader = gl_compile_shader(GL_FRAGMENT_SHADER, with_defines(fragment_shader_source, defines));
 
 	GLuint program = glCreateProgram();
+	if (retrievable) program_binary_api().ProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 	glAttachShader(program, vertex_shader);
 	glAttachShader(program, fragment_shader);
 
@@ -60,3 +243,83 @@ GLuint gl_compile_program(
 
 	return program;
 }
+
+GLuint gl_compile_program(
+	std::string const &vertex_shader_source,
+	std::string const &fragment_shader_source,
+	std::string const &defines
+	) {
+	auto before = std::chrono::high_resolution_clock::now();
+	auto seconds_since_before = [&before]() {
+		return std::chrono::duration< float >(std::chrono::high_resolution_clock::now() - before).count();
+	};
+
+	ProgramBinaryAPI const &api = program_binary_api();
+	if (!api.supported) {
+		GLuint program = compile_and_link(vertex_shader_source, fragment_shader_source, defines, false);
+		stats.compiled += 1;
+		stats.compile_seconds += seconds_since_before();
+		return program;
+	}
+
+	//cache files are named by a hash of the sources; the driver string is checked against the one stored in the file:
+	uint64_t hash = hash_source(defines, hash_source(fragment_shader_source, hash_source(vertex_shader_source)));
+	char name[32];
+	std::snprintf(name, sizeof(name), "program-%016llx.bin", (unsigned long long)hash);
+	std::string path = user_path(name);
+	used_names.emplace_back(name);
+
+	if (GLuint program = load_program_binary(path)) {
+		stats.cached += 1;
+		stats.cached_seconds += seconds_since_before();
+		return program;
+	}
+
+	GLuint program = compile_and_link(vertex_shader_source, fragment_shader_source, defines, true);
+	stats.compiled += 1;
+	stats.compile_seconds += seconds_since_before(); //(not counting the time spent saving)
+	save_program_binary(path, program);
+	return program;
+}
+
+void gl_compile_program_report() {
+	std::cout << "Shader programs: " << stats.compiled << " compiled from source in " << stats.compile_seconds * 1000.0f << "ms, "
+	          << stats.cached << " loaded from cache in " << stats.cached_seconds * 1000.0f << "ms";
+	if (!program_binary_api().supported) std::cout << " (program binaries not supported)";
+	std::cout << "." << std::endl;
+}
+
+//list names in 'dir' that start with 'prefix':
+static std::vector< std::string > list_files(std::string const &dir, std::string const &prefix) {
+	std::vector< std::string > names;
+	#if defined(_WIN32)
+	WIN32_FIND_DATAA data;
+	HANDLE find = FindFirstFileA((dir + prefix + "*").c_str(), &data);
+	if (find == INVALID_HANDLE_VALUE) return names;
+	do {
+		names.emplace_back(data.cFileName);
+	} while (FindNextFileA(find, &data));
+	FindClose(find);
+	#else
+	DIR *d = opendir(dir.c_str());
+	if (!d) return names;
+	while (dirent *entry = readdir(d)) {
+		std::string name = entry->d_name;
+		if (name.compare(0, prefix.size(), prefix) == 0) names.emplace_back(name);
+	}
+	closedir(d);
+	#endif
+	return names;
+}
+
+void gl_compile_program_prune_cache() {
+	if (!program_binary_api().supported) return; //(nothing was looked up, so everything would look stale)
+
+	uint32_t removed = 0;
+	for (std::string const &name : list_files(user_path(""), "program-")) {
+		if (std::find(used_names.begin(), used_names.end(), name) != used_names.end()) continue;
+		//(also catches '.tmp' files left by an interrupted save)
+		if (std::remove(user_path(name).c_str()) == 0) removed += 1;
+	}
+	if (removed) std::cout << "Removed " << removed << " stale program cache file(s)." << std::endl;
+}
@@ -5,7 +5,22 @@
 #include <string>
 
 //compiles+links an OpenGL shader program from source.
+// 'defines' (e.g., "#define LIGHTS 4\n") is inserted into both shaders right after their #version line,
+// so one source can be compiled into several variants.
 // throws on compilation error.
 GLuint gl_compile_program(
 	std::string const &vertex_shader_source,
-	std::string const &fragment_shader_source);
+	std::string const &fragment_shader_source,
+	std::string const &defines = "");
+
+//Linked programs are cached (with glGetProgramBinary, when the driver supports it) in user_path(),
+// keyed by a hash of the sources and defines along with the driver's vendor/renderer/version strings.
+//Later runs load the binary instead of compiling, falling back to compiling on any mismatch.
+
+//print how many programs were compiled vs. loaded from the cache, and how long each took:
+void gl_compile_program_report();
+
+//delete cached programs not compiled or loaded so far this run (e.g., from older versions of the shaders),
+// so the cache doesn't grow without bound. Call once every program the executable uses has been made.
+// (executables that share the directory but make different programs, like show-meshes, just rebuild their entries next run)
+void gl_compile_program_prune_cache();
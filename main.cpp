@@ -13,6 +13,9 @@
 //GL.hpp will include a non-namespace-polluting set of opengl prototypes:
 #include "GL.hpp"
 
+//for reporting shader compile times:
+#include "gl_compile_program.hpp"
+
 //for screenshots:
 #include "load_save_png.hpp"
 
@@ -117,6 +120,10 @@ int main(int argc, char **argv) {
 	//------------ create game mode + make current --------------
 	Mode::set_current(std::make_shared< GP22IntroMode >( std::make_shared< PlayMode >() ));
 
+	//(every startup shader program has been compiled or loaded by now)
+	gl_compile_program_report();
+	gl_compile_program_prune_cache();
+
 	//------------ main loop ------------
 
 	//this inline function will be called whenever the window is resized,
@@ -4,6 +4,8 @@
 #include <vector>
 #include <stdexcept>
 #include <cassert>
+#include <cstring>
+#include <string>
 
 //helper function that reads an array of structures preceded by a simple header:
 //Expected format:
@@ -35,12 +37,49 @@ void read_chunk(std::istream &from, std::string const &magic, std::vector< T > *
 	}
 
 	to.resize(header.size / sizeof(T));
-	if (!from.read(reinterpret_cast< char * >(&to[0]), to.size() * sizeof(T))) {
+	if (!from.read(reinterpret_cast< char * >(to.data()), to.size() * sizeof(T))) {
 		throw std::runtime_error("Failed to read chunk data.");
 	}
 }
 
 
+//same as above, but reads from a block of memory (e.g., a mapped file):
+// 'from' is advanced past the chunk; the data is copied out with a single memcpy.
+template< typename T >
+void read_chunk(char const **from_, char const *end, std::string const &magic, std::vector< T > *to_) {
+	assert(from_);
+	assert(to_);
+	auto &from = *from_;
+	auto &to = *to_;
+
+	struct ChunkHeader {
+		char magic[4] = {'\0', '\0', '\0', '\0'};
+		uint32_t size = 0;
+	};
+	static_assert(sizeof(ChunkHeader) == 8, "header is packed");
+
+	ChunkHeader header;
+	if (from == nullptr || size_t(end - from) < sizeof(header)) {
+		throw std::runtime_error("Failed to read chunk header");
+	}
+	std::memcpy(&header, from, sizeof(header));
+	from += sizeof(header);
+	if (std::string(header.magic,4) != magic) {
+		throw std::runtime_error("Unexpected magic number in chunk");
+	}
+
+	if (header.size % sizeof(T) != 0) {
+		throw std::runtime_error("Size of chunk not divisible by element size");
+	}
+	if (size_t(end - from) < header.size) {
+		throw std::runtime_error("Failed to read chunk data.");
+	}
+
+	to.resize(header.size / sizeof(T));
+	if (header.size != 0) std::memcpy(reinterpret_cast< char * >(&to[0]), from, header.size);
+	from += header.size;
+}
+
 //helper function to write a chunk of data in the same format as read_chunk:
 template< typename T >
 void write_chunk(std::string const &magic, std::vector< T > const &from, std::ostream *to_) {
@@ -0,0 +1,121 @@
+#include "Gameplay.hpp"
+#include "ReplayLog.hpp"
+#include "Beatmap.hpp"
+#include "data_path.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//replay-gameplay re-runs a recorded play (see ReplayLog.hpp) headless -- no window, no audio device --
+// and checks that it reproduces every recorded checkpoint of score, combo and health:
+// usage: ./replay-gameplay [--trace] [replay (default: last.replay in the user directory, where the game writes it)] [beatmap (default: the replay's song in beatmaps/)]
+int main(int argc, char **argv) {
+	bool trace = false;
+	std::vector< std::string > args;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--trace") trace = true;
+		else args.emplace_back(arg);
+	}
+	if (args.size() > 2) {
+		std::cerr << "Usage:\n\t./replay-gameplay [--trace] [replay] [beatmap]" << std::endl;
+		return 1;
+	}
+	std::string replay_path = (args.size() > 0 ? args[0] : user_path("last.replay"));
+
+	try {
+		ReplayLog recorded(replay_path);
+		if (recorded.header.step_time != Gameplay::StepTime) {
+			throw std::runtime_error("Replay was recorded with a step time of " + std::to_string(recorded.header.step_time) + "s, but gameplay steps are " + std::to_string(Gameplay::StepTime) + "s.");
+		}
+
+		std::string beatmap_path;
+		if (args.size() > 1) {
+			beatmap_path = args[1];
+		} else {
+			beatmap_path = data_path("beatmaps/" + recorded.song + ".beatc");
+			if (!std::ifstream(beatmap_path).good()) beatmap_path = data_path("beatmaps/" + recorded.song + ".txt");
+		}
+
+		//rebuild the notes exactly as PlayMode::read_notes did:
+		Gameplay gameplay;
+		Beatmap beatmap(beatmap_path);
+		NoteStore notes;
+		notes.build(beatmap, gameplay.real_song_offset);
+		for (uint32_t i = 0; i < notes.size(); ++i) {
+			if (notes.skin[i] >= recorded.skin_min.size()) {
+				throw std::runtime_error("Beatmap '" + beatmap_path + "' uses skin mesh " + std::to_string(notes.skin[i]) + ", but the replay only has bounds for " + std::to_string(recorded.skin_min.size()) + ".");
+			}
+			notes.min[i] = recorded.skin_min[notes.skin[i]];
+			notes.max[i] = recorded.skin_max[notes.skin[i]];
+		}
+		std::vector< Gameplay::Placement > placements;
+		gameplay.place_notes(beatmap, &placements);
+
+		glm::vec3 camera_position = glm::vec3(recorded.header.camera_position[0], recorded.header.camera_position[1], recorded.header.camera_position[2]);
+		gameplay.start(notes, placements, camera_position, recorded.header.is_tutorial != 0);
+
+		ReplayLog replayed;
+		gameplay.recording = &replayed;
+
+		auto report = [&]() {
+			for (auto const &event : gameplay.events) {
+				if (trace && event.type == Gameplay::Event::Judge) {
+					std::cout << "step " << gameplay.steps << ": note " << event.note << " judged " << event.status << "\n";
+				}
+			}
+			gameplay.events.clear();
+		};
+
+		//feed the inputs back at the steps they were applied at:
+		auto before = std::chrono::high_resolution_clock::now();
+		for (auto const &input : recorded.inputs) {
+			gameplay.step_to(input.step);
+			report();
+			gameplay.apply(input);
+			report();
+		}
+		if (!recorded.checkpoints.empty()) {
+			gameplay.step_to(recorded.checkpoints.back().step);
+			report();
+		}
+		gameplay.checkpoint();
+		auto after = std::chrono::high_resolution_clock::now();
+
+		//compare checkpoints:
+		uint32_t mismatches = 0;
+		if (replayed.checkpoints.size() != recorded.checkpoints.size()) {
+			std::cout << "Replay has " << replayed.checkpoints.size() << " checkpoints, recording has " << recorded.checkpoints.size() << ".\n";
+			mismatches += 1;
+		}
+		for (size_t i = 0; i < std::min(replayed.checkpoints.size(), recorded.checkpoints.size()); ++i) {
+			ReplayLog::Checkpoint const &a = recorded.checkpoints[i];
+			ReplayLog::Checkpoint const &b = replayed.checkpoints[i];
+			bool same = a.step == b.step && a.score == b.score && a.combo == b.combo && a.max_combo == b.max_combo && a.health == b.health;
+			if (!same) mismatches += 1;
+			if (trace || !same) {
+				std::cout << (same ? "  " : "! ") << "step " << b.step << " (" << b.step * Gameplay::StepTime << "s): score " << b.score << " combo " << b.combo << " max combo " << b.max_combo << " health " << b.health;
+				if (!same) std::cout << " (recorded step " << a.step << ": score " << a.score << " combo " << a.combo << " max combo " << a.max_combo << " health " << a.health << ")";
+				std::cout << "\n";
+			}
+		}
+
+		double seconds = std::chrono::duration< double >(after - before).count();
+		std::cout << "Replayed '" << recorded.song << "': " << recorded.inputs.size() << " inputs over " << gameplay.steps << " steps (" << gameplay.step_music_time() << "s of song) in " << seconds * 1000.0 << "ms.\n";
+		std::cout << "Final score " << gameplay.score << ", max combo " << gameplay.max_combo << ", health " << gameplay.health << (gameplay.failed ? " (failed)" : "") << ".\n";
+		if (mismatches != 0) {
+			std::cout << mismatches << " checkpoint(s) differ from the recording." << std::endl;
+			return 1;
+		}
+		std::cout << "All " << replayed.checkpoints.size() << " checkpoints match the recording." << std::endl;
+	} catch (std::exception const &e) {
+		std::cerr << "Failed to replay:\n" << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}